@@ -28,21 +28,40 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 #include <Box2D/Box2D.h>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/Pointer.h>
 #include <Corrade/Utility/Arguments.h>
+#include <Corrade/Utility/Format.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
 #include <Magnum/GL/Context.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
+#include <Magnum/GL/Extensions.h>
 #include <Magnum/GL/Buffer.h>
 #include <Magnum/GL/Mesh.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/Version.h>
 #include <Magnum/Math/DualComplex.h>
+#include <Magnum/Math/Functions.h>
 #include <Magnum/MeshTools/Compile.h>
 #include <Magnum/Platform/Sdl2Application.h>
 #include <Magnum/Primitives/Square.h>
 #include <Magnum/SceneGraph/Camera.h>
-#include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/TranslationRotationScalingTransformation2D.h>
 #include <Magnum/SceneGraph/Scene.h>
-#include <Magnum/Shaders/Flat.h>
+#include <Magnum/Shaders/Generic.h>
+#include <Magnum/Timeline.h>
 #include <Magnum/Trade/MeshData2D.h>
 
 namespace Magnum { namespace Examples {
@@ -52,49 +71,257 @@ typedef SceneGraph::Scene<SceneGraph::TranslationRotationScalingTransformation2D
 
 using namespace Math::Literals;
 
-class Box2DExample: public Platform::Application {
+/* Flat shader drawing many instances of the square mesh, each with its own
+   position, rotation and size */
+class InstancedBoxShader: public GL::AbstractShaderProgram {
     public:
-        explicit Box2DExample(const Arguments& arguments);
+        typedef Shaders::Generic2D::Position Position;
+
+        /* Above the generic attributes */
+        typedef GL::Attribute<8, Vector2> Translation;
+        /* Cosine and sine of the angle */
+        typedef GL::Attribute<9, Vector2> Rotation;
+        typedef GL::Attribute<10, Vector2> HalfSize;
+
+        explicit InstancedBoxShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        explicit InstancedBoxShader();
+
+        InstancedBoxShader& setTransformationProjectionMatrix(const Matrix3& matrix) {
+            setUniform(_transformationProjectionMatrixUniform, matrix);
+            return *this;
+        }
+
+        InstancedBoxShader& setColor(const Color4& color) {
+            setUniform(_colorUniform, color);
+            return *this;
+        }
 
     private:
-        void drawEvent() override;
-        void mousePressEvent(MouseEvent& event) override;
+        Int _transformationProjectionMatrixUniform,
+            _colorUniform;
+};
 
-        b2Body* createBody(Object2D& object, const Vector2& size, b2BodyType type, const DualComplex& transformation, Float density = 1.0f);
+InstancedBoxShader::InstancedBoxShader() {
+    Utility::Resource rs("box2d-data");
 
-        GL::Mesh _mesh{NoCreate};
-        Shaders::Flat2D _shader{NoCreate};
+    #ifndef MAGNUM_TARGET_GLES
+    const GL::Version version = GL::Version::GL330;
+    #elif !defined(MAGNUM_TARGET_GLES2)
+    const GL::Version version = GL::Version::GLES300;
+    #else
+    const GL::Version version = GL::Version::GLES200;
+    #endif
 
-        Scene2D _scene;
-        Object2D* _cameraObject;
-        SceneGraph::Camera2D* _camera;
-        SceneGraph::DrawableGroup2D _drawables;
-        Containers::Optional<b2World> _world;
+    GL::Shader vert{version, GL::Shader::Type::Vertex},
+        frag{version, GL::Shader::Type::Fragment};
+    #ifndef MAGNUM_TARGET_GLES2
+    vert.addSource("#define NEW_GLSL\n");
+    frag.addSource("#define NEW_GLSL\n");
+    #endif
+    vert.addSource(rs.get("InstancedBox.vert"));
+    frag.addSource(rs.get("InstancedBox.frag"));
+    CORRADE_INTERNAL_ASSERT(GL::Shader::compile({vert, frag}));
+    attachShaders({vert, frag});
+
+    bindAttributeLocation(Position::Location, "position");
+    bindAttributeLocation(Translation::Location, "instanceTranslation");
+    bindAttributeLocation(Rotation::Location, "instanceRotation");
+    bindAttributeLocation(HalfSize::Location, "instanceHalfSize");
+    CORRADE_INTERNAL_ASSERT(link());
+
+    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+    _colorUniform = uniformLocation("color");
+}
+
+/* The world is always stepped by the same time step, independently of the
+   frame rate. If the simulation can't keep up, at most this many steps are
+   done in a frame and it slows down instead of making the frames ever
+   longer. */
+constexpr Float TimeStep = 1.0f/60.0f;
+constexpr Int MaxStepsPerFrame = 5;
+
+/* Boxes of the same color are drawn with a single instanced draw. The
+   bodies have no scene graph objects, as nothing is attached to them --- the
+   instance data are filled right from the body list. */
+struct BoxBatch {
+    struct Box {
+        b2Body* body;
+        Vector2 halfSize;
+        /* Transformation before the last step, for interpolation */
+        b2Transform previous;
+    };
+
+    explicit BoxBatch(const Color4& color): color{color} {}
+
+    Color4 color;
+    std::vector<Box> boxes;
+    GL::Buffer instanceBuffer{NoCreate};
+    GL::Mesh mesh{NoCreate};
 };
 
-class BoxDrawable: public SceneGraph::Drawable2D {
+/* Independent part of the scene with its own world, containing bodies that
+   were created up to given X coordinate */
+struct Partition {
+    Containers::Pointer<b2World> world;
+    Float right;
+};
+
+/* Runs jobs on a fixed set of threads, the calling thread included */
+class ThreadPool {
     public:
-        explicit BoxDrawable(Object2D& object, GL::Mesh& mesh, Shaders::Flat2D& shader, const Color4& color, SceneGraph::DrawableGroup2D& drawables): SceneGraph::Drawable2D{object, &drawables}, _mesh(mesh), _shader(shader), _color{color} {}
+        explicit ThreadPool(std::size_t threadCount);
+
+        ~ThreadPool();
+
+        /* Calls job(i) for all i from 0 to count, returns once all of them
+           are done */
+        void run(std::size_t count, const std::function<void(std::size_t)>& job);
 
     private:
-        void draw(const Matrix3& transformationMatrix, SceneGraph::Camera2D& camera) override {
-            _shader
-                .setTransformationProjectionMatrix(camera.projectionMatrix()*transformationMatrix)
-                .setColor(_color);
-            _mesh.draw(_shader);
+        void worker();
+        void work();
+
+        std::vector<std::thread> _threads;
+        std::mutex _mutex;
+        std::condition_variable _wake, _finished;
+        const std::function<void(std::size_t)>* _job{};
+        std::size_t _count{}, _generation{}, _finishedThreadCount{};
+        std::atomic<std::size_t> _next{};
+        bool _quit{};
+};
+
+ThreadPool::ThreadPool(const std::size_t threadCount) {
+    for(std::size_t i = 1; i < threadCount; ++i)
+        _threads.emplace_back(&ThreadPool::worker, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _quit = true;
+    }
+    _wake.notify_all();
+    for(std::thread& thread: _threads) thread.join();
+}
+
+void ThreadPool::run(const std::size_t count, const std::function<void(std::size_t)>& job) {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _job = &job;
+        _count = count;
+        _next = 0;
+        _finishedThreadCount = 0;
+        ++_generation;
+    }
+    _wake.notify_all();
+    work();
+
+    /* Wait until every thread is done with this run, so none of them is
+       still looking at the job when the next run starts */
+    std::unique_lock<std::mutex> lock{_mutex};
+    _finished.wait(lock, [this]{ return _finishedThreadCount == _threads.size(); });
+}
+
+void ThreadPool::worker() {
+    std::size_t generation = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake.wait(lock, [&]{ return _quit || _generation != generation; });
+            if(_quit) return;
+            generation = _generation;
         }
 
-        GL::Mesh& _mesh;
-        Shaders::Flat2D& _shader;
-        Color4 _color;
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            ++_finishedThreadCount;
+        }
+        _finished.notify_one();
+    }
+}
+
+void ThreadPool::work() {
+    for(std::size_t i; (i = _next++) < _count; ) (*_job)(i);
+}
+
+class Box2DExample: public Platform::Application {
+    public:
+        explicit Box2DExample(const Arguments& arguments);
+
+    private:
+        void drawEvent() override;
+        void mousePressEvent(MouseEvent& event) override;
+
+        b2Body* createBody(b2World& world, const Vector2& size, b2BodyType type, const DualComplex& transformation, BoxBatch* batch, Float density = 1.0f);
+        std::size_t partitionCount() const;
+        b2World& worldAt(Float x);
+        void createScene();
+        void benchmark(std::size_t maxThreadCount, std::size_t stepCount);
+        void spawnDestroyer(const Vector2& position);
+        void removeFallenBodies();
+        void step();
+        void stepWorlds();
+        void drawBatch(BoxBatch& batch);
+
+        /* Position, rotation and half-size of each box, filled directly from
+           the Box2D bodies */
+        struct InstanceData {
+            Vector2 translation;
+            Vector2 rotation;
+            Vector2 halfSize;
+        };
+        std::vector<InstanceData> _instanceData;
+        InstancedBoxShader _shader{NoCreate};
+        BoxBatch _ground{0xa5c9ea_rgbf}, _pyramids{0x2f83cc_rgbf},
+            _destroyers{0xffff66_rgbf};
+
+        Scene2D _scene;
+        Object2D* _cameraObject;
+        SceneGraph::Camera2D* _camera;
+        Timeline _timeline;
+
+        /* The scene is either a single world or, with --partition, a world
+           for each pyramid. The worlds are independent, so they can be
+           stepped in parallel. Boxes crossing to another part of the scene
+           don't collide with anything there except the ground. Box2D
+           however updates global TOI and GJK statistics counters from
+           b2TimeOfImpact() and b2Distance() without any synchronization, so
+           stepping in parallel races on those. The simulation doesn't
+           depend on them, see the docs for a ThreadSanitizer suppression. */
+        std::vector<Partition> _partitions;
+        Containers::Pointer<ThreadPool> _threadPool;
+        DualComplex _globalTransformation;
+        std::size_t _rows, _pyramidCount;
+        Float _pyramidWidth, _groundHalfWidth;
+        bool _partitioned{};
+
+        /* Time not simulated yet, less than one step. It's used to
+           interpolate between the last two steps. */
+        Float _accumulator{}, _alpha{};
+
+        /* Destroyers falling from above at random positions, given count
+           per second */
+        Float _spawnRate{}, _spawnCount{}, _spawnWidth{}, _spawnHeight{};
+        std::minstd_rand _random;
+
+        /* Step and render time, averaged over a second and shown in the
+           window title, optionally also printed */
+        std::string _title;
+        bool _printStats{};
+        Double _stepTime{}, _renderTime{};
+        std::size_t _contactCount{}, _statsFrameCount{}, _stepCount{};
+        Float _statsDuration{};
 };
 
-b2Body* Box2DExample::createBody(Object2D& object, const Vector2& halfSize, const b2BodyType type, const DualComplex& transformation, const Float density) {
+b2Body* Box2DExample::createBody(b2World& world, const Vector2& halfSize, const b2BodyType type, const DualComplex& transformation, BoxBatch* const batch, const Float density) {
     b2BodyDef bodyDefinition;
     bodyDefinition.position.Set(transformation.translation().x(), transformation.translation().y());
     bodyDefinition.angle = Float(transformation.rotation().angle());
     bodyDefinition.type = type;
-    b2Body* body = _world->CreateBody(&bodyDefinition);
+    b2Body* body = world.CreateBody(&bodyDefinition);
 
     b2PolygonShape shape;
     shape.SetAsBox(halfSize.x(), halfSize.y());
@@ -105,27 +332,78 @@ b2Body* Box2DExample::createBody(Object2D& object, const Vector2& halfSize, cons
     fixture.shape = &shape;
     body->CreateFixture(&fixture);
 
-    body->SetUserData(&object);
-    object.setScaling(halfSize);
+    /* Bodies that are not in any batch aren't drawn */
+    if(batch) batch->boxes.push_back({body, halfSize, body->GetTransform()});
 
     return body;
 }
 
+std::size_t Box2DExample::partitionCount() const {
+    /* A world for each pyramid, but always at least one */
+    return _partitioned ? Math::max(_pyramidCount, std::size_t{1}) : 1;
+}
+
+b2World& Box2DExample::worldAt(const Float x) {
+    /* The world of the part of the scene given X coordinate is in */
+    std::size_t partition = 0;
+    while(partition + 1 < _partitions.size() && _partitions[partition].right < x)
+        ++partition;
+    return *_partitions[partition].world;
+}
+
 Box2DExample::Box2DExample(const Arguments& arguments): Platform::Application{arguments, NoCreate} {
     /* Make it possible for the user to have some fun */
     Utility::Arguments args;
     args.addOption("transformation", "1 0 0 0").setHelp("transformation", "initial pyramid transformation")
+        .addOption("rows", "15").setHelp("rows", "row count of each pyramid", "N")
+        .addOption("pyramids", "1").setHelp("pyramids", "count of pyramids next to each other", "N")
+        .addOption("spawn-rate", "0").setHelp("spawn-rate", "drop this many destroyer boxes per second from above", "N")
+        .addBooleanOption("print-stats").setHelp("print-stats", "print the step and render time every second")
+        .addBooleanOption("partition").setHelp("partition", "simulate each pyramid in its own world")
+        .addOption("threads", "1").setHelp("threads", "step the worlds of a partitioned scene on this many threads", "N")
+        .addOption("benchmark-threads", "0").setHelp("benchmark-threads", "measure stepping of a partitioned scene on one up to this many threads and exit", "N")
+        .addOption("benchmark-steps", "600").setHelp("benchmark-steps", "step count for --benchmark-threads", "N")
         .addSkippedPrefix("magnum").setHelp("engine-specific options")
         .parse(arguments.argc, arguments.argv);
 
-    const DualComplex globalTransformation = args.value<DualComplex>("transformation").normalized();
+    _globalTransformation = args.value<DualComplex>("transformation").normalized();
+    _rows = args.value<std::size_t>("rows");
+    _pyramidCount = args.value<std::size_t>("pyramids");
+    _spawnRate = args.value<Float>("spawn-rate");
+    _printStats = args.isSet("print-stats");
+
+    /* The pyramids are next to each other with a gap between, the ground
+       is large enough for all of them. Destroyers fall on the whole ground
+       from above the pyramids. */
+    _pyramidWidth = Float(_rows)*1.2f;
+    _groundHalfWidth = Math::max(11.0f, (_pyramidWidth + 2.0f)*Float(_pyramidCount)*0.5f);
+    const Float viewSize = Math::max(20.0f, _groundHalfWidth*2.0f - 2.0f);
+    _spawnWidth = _groundHalfWidth*2.0f;
+    _spawnHeight = Float(_rows) - 4.0f;
+
+    /* The benchmark needs just the physics, so it's done before creating
+       the window */
+    if(const std::size_t maxThreadCount = args.value<std::size_t>("benchmark-threads")) {
+        benchmark(maxThreadCount, args.value<std::size_t>("benchmark-steps"));
+        std::exit(0);
+    }
+
+    _partitioned = args.isSet("partition");
+    const std::size_t threadCount = args.value<std::size_t>("threads");
+    if(threadCount > 1 && !_partitioned)
+        Warning{} << "A scene that's not partitioned can't be stepped in parallel, ignoring --threads";
+    else if(threadCount > 1)
+        _threadPool.reset(new ThreadPool{threadCount});
 
     /* Try 8x MSAA, fall back to zero samples if not possible. Enable only 2x
        MSAA if we have enough DPI. */
+    _title = "Magnum Box2D Example";
+    if(_partitioned)
+        _title += Utility::format(" ({} worlds, {} threads)", partitionCount(), _threadPool ? threadCount : 1);
     {
         const Vector2 dpiScaling = this->dpiScaling({});
         Configuration conf;
-        conf.setTitle("Magnum Box2D Example")
+        conf.setTitle(_title)
             .setSize(conf.size(), dpiScaling);
         GLConfiguration glConf;
         glConf.setSampleCount(dpiScaling.max() < 2.0f ? 8 : 2);
@@ -133,40 +411,100 @@ Box2DExample::Box2DExample(const Arguments& arguments): Platform::Application{ar
             create(conf, glConf.setSampleCount(0));
     }
 
-    /* Configure camera */
+    /* Configure camera, keeping the ground at the bottom */
     _cameraObject = new Object2D{&_scene};
+    _cameraObject->setTranslation(Vector2::yAxis(viewSize*0.5f - 10.0f));
     _camera = new SceneGraph::Camera2D{*_cameraObject};
     _camera->setAspectRatioPolicy(SceneGraph::AspectRatioPolicy::Extend)
-        .setProjectionMatrix(Matrix3::projection({20.0f, 20.0f}))
+        .setProjectionMatrix(Matrix3::projection(Vector2{viewSize}))
         .setViewport(GL::defaultFramebuffer.viewport().size());
 
-    /* Create the Box2D world with the usual gravity vector */
-    _world.emplace(b2Vec2{0.0f, -9.81f});
-
-    /* Create the shader and the box mesh */
-    _shader = Shaders::Flat2D{};
-    _mesh = MeshTools::compile(Primitives::squareSolid());
-
-    /* Create the ground */
-    auto ground = new Object2D{&_scene};
-    createBody(*ground, {11.0f, 0.5f}, b2_staticBody, DualComplex::translation(Vector2::yAxis(-8.0f)));
-    new BoxDrawable{*ground, _mesh, _shader, 0xa5c9ea_rgbf, _drawables};
-
-    /* Create a pyramid of boxes */
-    for(std::size_t row = 0; row != 15; ++row) {
-        for(std::size_t item = 0; item != 15 - row; ++item) {
-            auto box = new Object2D{&_scene};
-            const DualComplex transformation = globalTransformation*DualComplex::translation(
-                {Float(row)*0.6f + Float(item)*1.2f - 8.5f, Float(row)*1.0f - 6.0f});
-            createBody(*box, {0.5f, 0.5f}, b2_dynamicBody, transformation);
-            new BoxDrawable{*box, _mesh, _shader, 0x2f83cc_rgbf, _drawables};
-        }
+    /* Create the shader and the box mesh with an instance buffer for each
+       batch. ES2 needs an extension for instancing. */
+    #ifdef MAGNUM_TARGET_GLES2
+    if(!GL::Context::current().isExtensionSupported<GL::Extensions::ANGLE::instanced_arrays>()
+        #ifndef MAGNUM_TARGET_WEBGL
+        && !GL::Context::current().isExtensionSupported<GL::Extensions::EXT::instanced_arrays>()
+        && !GL::Context::current().isExtensionSupported<GL::Extensions::NV::instanced_arrays>()
+        #endif
+    ) {
+        Error{} << "Instanced arrays are not supported";
+        std::exit(1);
     }
+    #endif
+    _shader = InstancedBoxShader{};
+    for(BoxBatch* batch: {&_ground, &_pyramids, &_destroyers}) {
+        batch->instanceBuffer = GL::Buffer{};
+        batch->mesh = MeshTools::compile(Primitives::squareSolid());
+        batch->mesh.addVertexBufferInstanced(batch->instanceBuffer, 1, 0,
+            InstancedBoxShader::Translation{},
+            InstancedBoxShader::Rotation{},
+            InstancedBoxShader::HalfSize{});
+    }
+
+    createScene();
 
     setSwapInterval(1);
     #if !defined(CORRADE_TARGET_EMSCRIPTEN) && !defined(CORRADE_TARGET_ANDROID)
     setMinimalLoopPeriod(16);
     #endif
+    _timeline.start();
+}
+
+void Box2DExample::createScene() {
+    for(BoxBatch* batch: {&_ground, &_pyramids, &_destroyers})
+        batch->boxes.clear();
+    _partitions.clear();
+
+    /* Create the Box2D worlds with the usual gravity vector. A partition
+       ends in the middle between two pyramids, the last one at the end of
+       the ground. */
+    const std::size_t partitionCount = this->partitionCount();
+    for(std::size_t i = 0; i != partitionCount; ++i) {
+        const Float right = i + 1 == partitionCount ? _groundHalfWidth :
+            (Float(i) - Float(_pyramidCount - 1)*0.5f + 0.5f)*(_pyramidWidth + 2.0f) - 0.1f;
+        _partitions.push_back({Containers::Pointer<b2World>{new b2World{b2Vec2{0.0f, -9.81f}}}, right});
+    }
+
+    /* Create the ground. Each world has its own spanning the whole width, so
+       boxes that cross to another part of the scene still have something
+       to land on. It's drawn just once. */
+    for(std::size_t i = 0; i != _partitions.size(); ++i)
+        createBody(*_partitions[i].world, {_groundHalfWidth, 0.5f}, b2_staticBody, DualComplex::translation(Vector2::yAxis(-8.0f)), i == 0 ? &_ground : nullptr);
+
+    /* Create pyramids of boxes. With the defaults it's a single 15-row one
+       at the same place as it always was. Each box is put into the world
+       of the part of the scene it ends up in after the transformation. */
+    for(std::size_t pyramid = 0; pyramid != _pyramidCount; ++pyramid) {
+        const Float offset = (Float(pyramid) - Float(_pyramidCount - 1)*0.5f)*(_pyramidWidth + 2.0f) - 8.5f + (15.0f - Float(_rows))*0.6f;
+        for(std::size_t row = 0; row != _rows; ++row) {
+            for(std::size_t item = 0; item != _rows - row; ++item) {
+                const DualComplex transformation = _globalTransformation*DualComplex::translation(
+                    {Float(row)*0.6f + Float(item)*1.2f + offset, Float(row)*1.0f - 6.0f});
+                createBody(worldAt(transformation.translation().x()), {0.5f, 0.5f}, b2_dynamicBody, transformation, &_pyramids);
+            }
+        }
+    }
+}
+
+void Box2DExample::benchmark(const std::size_t maxThreadCount, const std::size_t stepCount) {
+    _partitioned = true;
+    Debug{} << "Stepping" << partitionCount() << "worlds with" << _pyramidCount*_rows*(_rows + 1)/2 << "boxes" << stepCount << "times";
+
+    /* Each thread count starts from the same initial scene */
+    Double singleThreadedTime{};
+    for(std::size_t threadCount = 1; threadCount <= maxThreadCount; ++threadCount) {
+        createScene();
+        _threadPool.reset(threadCount > 1 ? new ThreadPool{threadCount} : nullptr);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(std::size_t i = 0; i != stepCount; ++i) stepWorlds();
+        const Double time = std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if(threadCount == 1) singleThreadedTime = time;
+        Debug{} << Utility::format("{} threads: {:.3f} ms per step, {:.2f}x speedup",
+            threadCount, time/stepCount, singleThreadedTime/time);
+    }
 }
 
 void Box2DExample::mousePressEvent(MouseEvent& event) {
@@ -176,24 +514,138 @@ void Box2DExample::mousePressEvent(MouseEvent& event) {
        with origin at center and then scale to world size with Y inverted. */
     const auto position = _camera->projectionSize()*Vector2::yScale(-1.0f)*(Vector2{event.position()}/Vector2{windowSize()} - Vector2{0.5f});
 
-    auto destroyer = new Object2D{&_scene};
-    createBody(*destroyer, {0.5f, 0.5f}, b2_dynamicBody, DualComplex::translation(position), 2.0f);
-    new BoxDrawable{*destroyer, _mesh, _shader, 0xffff66_rgbf, _drawables};
+    spawnDestroyer(_cameraObject->translation() + position);
+}
+
+void Box2DExample::spawnDestroyer(const Vector2& position) {
+    createBody(worldAt(position.x()), {0.5f, 0.5f}, b2_dynamicBody, DualComplex::translation(position), &_destroyers, 2.0f);
+}
+
+void Box2DExample::drawBatch(BoxBatch& batch) {
+    if(batch.boxes.empty()) return;
+
+    /* Interpolate between the last two steps. Box2D has the rotation
+       already as a cosine and sine, which is interpolated linearly and
+       renormalized. */
+    _instanceData.resize(batch.boxes.size());
+    for(std::size_t i = 0; i != batch.boxes.size(); ++i) {
+        const BoxBatch::Box& box = batch.boxes[i];
+        const b2Transform& previous = box.previous;
+        const b2Transform& current = box.body->GetTransform();
+        _instanceData[i] = {
+            Math::lerp(Vector2{previous.p.x, previous.p.y},
+                       Vector2{current.p.x, current.p.y}, _alpha),
+            Math::lerp(Vector2{previous.q.c, previous.q.s},
+                       Vector2{current.q.c, current.q.s}, _alpha).normalized(),
+            box.halfSize};
+    }
+
+    /* Orphan the previous contents, the GPU might still be using them */
+    batch.instanceBuffer.setData({nullptr, _instanceData.size()*sizeof(InstanceData)}, GL::BufferUsage::StreamDraw);
+    batch.instanceBuffer.setSubData(0, Containers::arrayView(_instanceData.data(), _instanceData.size()));
+    batch.mesh.setInstanceCount(Int(_instanceData.size()));
+    _shader.setColor(batch.color);
+    batch.mesh.draw(_shader);
+}
+
+void Box2DExample::step() {
+    _accumulator += _timeline.previousFrameDuration();
+
+    Int steps = 0;
+    for(; _accumulator >= TimeStep && steps != MaxStepsPerFrame; ++steps) {
+        for(BoxBatch* batch: {&_ground, &_pyramids, &_destroyers})
+            for(BoxBatch::Box& box: batch->boxes)
+                box.previous = box.body->GetTransform();
+
+        stepWorlds();
+        _accumulator -= TimeStep;
+    }
+
+    /* If the simulation couldn't keep up, drop the whole steps that didn't
+       fit */
+    if(steps == MaxStepsPerFrame)
+        _accumulator -= Math::floor(_accumulator/TimeStep)*TimeStep;
+
+    _alpha = _accumulator/TimeStep;
+    _stepCount += steps;
+}
+
+void Box2DExample::stepWorlds() {
+    if(_threadPool) _threadPool->run(_partitions.size(), [this](std::size_t i) {
+        _partitions[i].world->Step(TimeStep, 6, 2);
+    });
+    else for(Partition& partition: _partitions)
+        partition.world->Step(TimeStep, 6, 2);
+}
+
+void Box2DExample::removeFallenBodies() {
+    /* Bodies that fell off the ground would fall forever, delete them. The
+       order in a batch doesn't matter, so the last box is moved in place of
+       the removed one. */
+    for(BoxBatch* batch: {&_pyramids, &_destroyers}) {
+        std::vector<BoxBatch::Box>& boxes = batch->boxes;
+        for(std::size_t i = 0; i < boxes.size(); ) {
+            if(boxes[i].body->GetPosition().y >= -100.0f) {
+                ++i;
+                continue;
+            }
+
+            boxes[i].body->GetWorld()->DestroyBody(boxes[i].body);
+            boxes[i] = boxes.back();
+            boxes.pop_back();
+        }
+    }
 }
 
 void Box2DExample::drawEvent() {
     GL::defaultFramebuffer.clear(GL::FramebufferClear::Color);
 
-    /* Step the world and update all object positions */
-    _world->Step(1.0f/60.0f, 6, 2);
-    for(b2Body* body = _world->GetBodyList(); body; body = body->GetNext())
-        (*static_cast<Object2D*>(body->GetUserData()))
-            .setTranslation({body->GetPosition().x, body->GetPosition().y})
-            .setRotation(Complex::rotation(Rad(body->GetAngle())));
-
-    _camera->draw(_drawables);
+    /* Drop as many destroyers as fit into this frame */
+    if(_spawnRate) {
+        std::uniform_real_distribution<Float> x{-0.5f*_spawnWidth, 0.5f*_spawnWidth};
+        _spawnCount += _spawnRate*_timeline.previousFrameDuration();
+        for(; _spawnCount >= 1.0f; _spawnCount -= 1.0f)
+            spawnDestroyer({x(_random), _spawnHeight});
+    }
+    removeFallenBodies();
+
+    /* Step the world by as many fixed steps as fit into the last frame */
+    const auto stepStart = std::chrono::high_resolution_clock::now();
+    step();
+    _stepTime += std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - stepStart).count();
+
+    /* Draw all boxes, copying their transformations straight from the
+       bodies. Only the CPU side of the rendering is measured, the GPU runs
+       asynchronously. */
+    const auto renderStart = std::chrono::high_resolution_clock::now();
+    _shader.setTransformationProjectionMatrix(_camera->projectionMatrix()*_camera->cameraMatrix());
+    drawBatch(_ground);
+    drawBatch(_pyramids);
+    drawBatch(_destroyers);
+    _renderTime += std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - renderStart).count();
+
+    /* Show the averages once a second */
+    std::size_t bodyCount = 0;
+    for(const Partition& partition: _partitions) {
+        bodyCount += partition.world->GetBodyCount();
+        _contactCount += partition.world->GetContactCount();
+    }
+    ++_statsFrameCount;
+    if((_statsDuration += _timeline.previousFrameDuration()) >= 1.0f) {
+        const Double n = _statsFrameCount;
+        const std::string stats = Utility::format("{} bodies, {} contacts, step {:.2f} ms ({:.2f} steps per frame, alpha {:.2f}), render {:.2f} ms",
+            bodyCount, std::size_t(_contactCount/n),
+            _stepTime/n, _stepCount/n, _alpha, _renderTime/n);
+        setWindowTitle(_title + " | " + stats);
+        if(_printStats) Debug{} << stats;
+
+        _stepTime = _renderTime = 0.0;
+        _contactCount = _statsFrameCount = _stepCount = 0;
+        _statsDuration = 0.0f;
+    }
 
     swapBuffers();
+    _timeline.nextFrame();
     redraw();
 }
 
@@ -0,0 +1,50 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NEW_GLSL
+#define in attribute
+#endif
+
+uniform highp mat3 transformationProjectionMatrix;
+
+in highp vec2 position;
+
+/* Per-instance body position, rotation as a cosine and sine of the angle
+   and half-size of the box */
+in highp vec2 instanceTranslation;
+in mediump vec2 instanceRotation;
+in highp vec2 instanceHalfSize;
+
+void main() {
+    highp vec2 scaled = position*instanceHalfSize;
+    highp vec2 rotated = vec2(
+        instanceRotation.x*scaled.x - instanceRotation.y*scaled.y,
+        instanceRotation.y*scaled.x + instanceRotation.x*scaled.y);
+    gl_Position.xywz = vec4(transformationProjectionMatrix*vec3(rotated + instanceTranslation, 1.0), 0.0);
+}
@@ -29,26 +29,66 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btGhostObject.h>
+#include <LinearMath/btAlignedAllocator.h>
+#include <LinearMath/btQuickprof.h>
+#include <LinearMath/btTransformUtil.h>
+/* The multithreaded world and task schedulers are only since 2.88 */
+#if BT_BULLET_VERSION >= 288
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <LinearMath/btThreads.h>
+#endif
+#include <Corrade/Containers/Array.h>
+#include <Corrade/Containers/ArrayView.h>
 #include <Corrade/Containers/Optional.h>
 #include <Corrade/Containers/Pointer.h>
+#include <Corrade/Utility/Arguments.h>
+#include <Corrade/Utility/Directory.h>
+#include <Corrade/Utility/Format.h>
+#include <Corrade/Utility/Resource.h>
 #include <Magnum/Timeline.h>
 #include <Magnum/BulletIntegration/Integration.h>
-#include <Magnum/BulletIntegration/MotionState.h>
 #include <Magnum/BulletIntegration/DebugDraw.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Context.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
+#include <Magnum/GL/Extensions.h>
 #include <Magnum/GL/Mesh.h>
 #include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/Version.h>
 #include <Magnum/Math/Constants.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Quaternion.h>
 #include <Magnum/MeshTools/Compile.h>
 #include <Magnum/MeshTools/Transform.h>
 #include <Magnum/Platform/Sdl2Application.h>
 #include <Magnum/Primitives/Cube.h>
 #include <Magnum/Primitives/UVSphere.h>
 #include <Magnum/SceneGraph/Camera.h>
+#include <Magnum/SceneGraph/AbstractGroupedFeature.h>
 #include <Magnum/SceneGraph/Drawable.h>
+#include <Magnum/SceneGraph/FeatureGroup.h>
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/SceneGraph/Scene.h>
+#include <Magnum/Shaders/Generic.h>
 #include <Magnum/Shaders/Phong.h>
 #include <Magnum/Trade/MeshData3D.h>
 
@@ -59,27 +99,509 @@ using namespace Math::Literals;
 typedef SceneGraph::Object<SceneGraph::MatrixTransformation3D> Object3D;
 typedef SceneGraph::Scene<SceneGraph::MatrixTransformation3D> Scene3D;
 
+/* Time spent in particular phases of the simulation step, collected from
+   Bullet profiling zones. Needs Bullet built without BT_NO_PROFILE,
+   otherwise only the total and the sync to the scene graph is known. */
+struct StepProfile {
+    enum Phase: std::size_t {
+        Broadphase,
+        Narrowphase,
+        Solver,
+        Integration,
+        Sync,
+        Total,
+        PhaseCount
+    };
+
+    StepProfile& operator+=(const StepProfile& other) {
+        for(std::size_t i = 0; i != PhaseCount; ++i) time[i] += other.time[i];
+        return *this;
+    }
+
+    /* In milliseconds */
+    Double time[PhaseCount]{};
+};
+
+namespace {
+
+/* Custom profile zone hooks are only since 2.86, on older versions just the
+   sync and total step time is measured */
+#if BT_BULLET_VERSION >= 286
+/* Bullet calls the zone hooks from all its worker threads as well, only the
+   zones on the thread that calls stepSimulation() are recorded */
+std::thread::id profiledThread;
+StepProfile* currentProfile;
+
+struct ProfileZone {
+    std::chrono::high_resolution_clock::time_point start;
+    Int phase;
+};
+std::vector<ProfileZone> profileZones;
+std::size_t profilePhaseDepth;
+#endif
+
+/* Counts allocations done by Bullet, including the ones on its worker
+   threads */
+std::atomic<std::size_t> bulletAllocationCount{0};
+
+void* countingBulletAlloc(const std::size_t size) {
+    ++bulletAllocationCount;
+    return std::malloc(size);
+}
+
+void countingBulletFree(void* const memblock) {
+    std::free(memblock);
+}
+
+#if BT_BULLET_VERSION >= 286
+Int profilePhase(const char* const name) {
+    if(std::strcmp(name, "updateAabbs") == 0 ||
+       std::strcmp(name, "calculateOverlappingPairs") == 0)
+        return StepProfile::Broadphase;
+    if(std::strcmp(name, "dispatchAllCollisionPairs") == 0)
+        return StepProfile::Narrowphase;
+    if(std::strcmp(name, "solveConstraints") == 0)
+        return StepProfile::Solver;
+    if(std::strcmp(name, "predictUnconstraintMotion") == 0 ||
+       std::strcmp(name, "integrateTransforms") == 0)
+        return StepProfile::Integration;
+    return -1;
+}
+
+void enterProfileZone(const char* const name) {
+    if(!currentProfile || std::this_thread::get_id() != profiledThread) return;
+
+    /* Zones nested in an already recorded one are not counted twice */
+    const Int phase = profilePhaseDepth ? -1 : profilePhase(name);
+    if(phase != -1) ++profilePhaseDepth;
+    profileZones.push_back({std::chrono::high_resolution_clock::now(), phase});
+}
+
+void leaveProfileZone() {
+    if(!currentProfile || std::this_thread::get_id() != profiledThread) return;
+
+    const ProfileZone zone = profileZones.back();
+    profileZones.pop_back();
+    if(zone.phase == -1) return;
+
+    --profilePhaseDepth;
+    currentProfile->time[zone.phase] += std::chrono::duration<Double, std::milli>(
+        std::chrono::high_resolution_clock::now() - zone.start).count();
+}
+#endif
+
+/* Recording of everything that affects the simulation in the deterministic
+   mode. The file starts with a magic, version, the box cube size and the
+   tick duration, followed by events. Each event is the frame in which it
+   happened, its type and a payload depending on the type. The last event is
+   End, with the frame count. Everything is in native byte order. */
+constexpr char RecordingMagic[]{'M', 'B', 'R', 'C'};
+constexpr UnsignedInt RecordingVersion = 1;
+
+enum class RecordedEventType: UnsignedByte {
+    ShootBox,       /* origin and direction */
+    ShootSphere,    /* origin and direction */
+    RotateCameraX,  /* angle in degrees */
+    RotateCameraY,  /* angle in degrees */
+    End             /* nothing */
+};
+
+struct RecordedEvent {
+    UnsignedInt frame;
+    RecordedEventType type;
+    Vector3 origin, direction;
+    Float angle;
+};
+
+template<class T> void writeRecorded(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void writeRecordedEvent(std::ostream& out, const RecordedEvent& event) {
+    writeRecorded(out, event.frame);
+    writeRecorded(out, event.type);
+    if(event.type == RecordedEventType::ShootBox ||
+       event.type == RecordedEventType::ShootSphere) {
+        writeRecorded(out, event.origin);
+        writeRecorded(out, event.direction);
+    } else if(event.type == RecordedEventType::RotateCameraX ||
+              event.type == RecordedEventType::RotateCameraY)
+        writeRecorded(out, event.angle);
+}
+
+template<class T> bool readRecorded(Containers::ArrayView<const char>& in, T& value) {
+    if(in.size() < sizeof(T)) return false;
+    std::memcpy(&value, in.data(), sizeof(T));
+    in = in.suffix(sizeof(T));
+    return true;
+}
+
+bool readRecordedEvent(Containers::ArrayView<const char>& in, RecordedEvent& event) {
+    if(!readRecorded(in, event.frame) || !readRecorded(in, event.type))
+        return false;
+    switch(event.type) {
+        case RecordedEventType::ShootBox:
+        case RecordedEventType::ShootSphere:
+            return readRecorded(in, event.origin) && readRecorded(in, event.direction);
+        case RecordedEventType::RotateCameraX:
+        case RecordedEventType::RotateCameraY:
+            return readRecorded(in, event.angle);
+        case RecordedEventType::End:
+            return true;
+    }
+
+    return false;
+}
+
+bool loadRecording(const std::string& filename, Int& boxCount, Float& tick, std::vector<RecordedEvent>& events) {
+    if(!Utility::Directory::exists(filename)) {
+        Error{} << "Can't open recording" << filename;
+        return false;
+    }
+
+    const Containers::Array<char> data = Utility::Directory::read(filename);
+    Containers::ArrayView<const char> in = data;
+    char magic[sizeof(RecordingMagic)];
+    UnsignedInt version;
+    if(!readRecorded(in, magic) || std::memcmp(magic, RecordingMagic, sizeof(magic)) != 0 || !readRecorded(in, version) || version != RecordingVersion) {
+        Error{} << filename << "is not a recording of version" << RecordingVersion;
+        return false;
+    }
+
+    if(!readRecorded(in, boxCount) || !readRecorded(in, tick)) {
+        Error{} << "Recording" << filename << "is truncated";
+        return false;
+    }
+
+    RecordedEvent event{};
+    do {
+        if(!readRecordedEvent(in, event)) {
+            Error{} << "Recording" << filename << "is truncated or corrupted";
+            return false;
+        }
+        events.push_back(event);
+    } while(event.type != RecordedEventType::End);
+
+    return true;
+}
+
+}
+
+/* Phong shader drawing many instances of the same mesh, each with its own
+   transformation and color */
+class InstancedPhongShader: public GL::AbstractShaderProgram {
+    public:
+        typedef Shaders::Generic3D::Position Position;
+        typedef Shaders::Generic3D::Normal Normal;
+
+        /* Above the generic attributes, a matrix occupies four locations */
+        typedef GL::Attribute<8, Matrix4> TransformationMatrix;
+        typedef GL::Attribute<12, Vector3> Color;
+
+        explicit InstancedPhongShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        explicit InstancedPhongShader();
+
+        InstancedPhongShader& setViewMatrix(const Matrix4& matrix) {
+            setUniform(_viewMatrixUniform, matrix);
+            return *this;
+        }
+
+        InstancedPhongShader& setProjectionMatrix(const Matrix4& matrix) {
+            setUniform(_projectionMatrixUniform, matrix);
+            return *this;
+        }
+
+        /* In camera space */
+        InstancedPhongShader& setLightPosition(const Vector3& position) {
+            setUniform(_lightPositionUniform, position);
+            return *this;
+        }
+
+        InstancedPhongShader& setAmbientColor(const Color3& color) {
+            setUniform(_ambientColorUniform, color);
+            return *this;
+        }
+
+        InstancedPhongShader& setSpecularColor(const Color3& color) {
+            setUniform(_specularColorUniform, color);
+            return *this;
+        }
+
+        InstancedPhongShader& setShininess(Float shininess) {
+            setUniform(_shininessUniform, shininess);
+            return *this;
+        }
+
+    private:
+        Int _viewMatrixUniform,
+            _projectionMatrixUniform,
+            _lightPositionUniform,
+            _ambientColorUniform,
+            _specularColorUniform,
+            _shininessUniform;
+};
+
+InstancedPhongShader::InstancedPhongShader() {
+    Utility::Resource rs("bullet-data");
+
+    #ifndef MAGNUM_TARGET_GLES
+    const GL::Version version = GL::Version::GL330;
+    #elif !defined(MAGNUM_TARGET_GLES2)
+    const GL::Version version = GL::Version::GLES300;
+    #else
+    const GL::Version version = GL::Version::GLES200;
+    #endif
+
+    GL::Shader vert{version, GL::Shader::Type::Vertex},
+        frag{version, GL::Shader::Type::Fragment};
+    #ifndef MAGNUM_TARGET_GLES2
+    vert.addSource("#define NEW_GLSL\n");
+    frag.addSource("#define NEW_GLSL\n");
+    #endif
+    vert.addSource(rs.get("InstancedPhong.vert"));
+    frag.addSource(rs.get("InstancedPhong.frag"));
+    CORRADE_INTERNAL_ASSERT(GL::Shader::compile({vert, frag}));
+    attachShaders({vert, frag});
+
+    bindAttributeLocation(Position::Location, "position");
+    bindAttributeLocation(Normal::Location, "normal");
+    bindAttributeLocation(TransformationMatrix::Location, "instanceTransformation");
+    bindAttributeLocation(Color::Location, "instanceColor");
+    CORRADE_INTERNAL_ASSERT(link());
+
+    _viewMatrixUniform = uniformLocation("viewMatrix");
+    _projectionMatrixUniform = uniformLocation("projectionMatrix");
+    _lightPositionUniform = uniformLocation("lightPosition");
+    _ambientColorUniform = uniformLocation("ambientColor");
+    _specularColorUniform = uniformLocation("specularColor");
+    _shininessUniform = uniformLocation("shininess");
+
+    setShininess(80.0f);
+}
+
+/* Flat shader drawing many instances of the same mesh, used for the debug
+   wireframes */
+class InstancedFlatShader: public GL::AbstractShaderProgram {
+    public:
+        typedef Shaders::Generic3D::Position Position;
+        typedef InstancedPhongShader::TransformationMatrix TransformationMatrix;
+        typedef InstancedPhongShader::Color Color;
+
+        explicit InstancedFlatShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        explicit InstancedFlatShader();
+
+        InstancedFlatShader& setTransformationProjectionMatrix(const Matrix4& matrix) {
+            setUniform(_transformationProjectionMatrixUniform, matrix);
+            return *this;
+        }
+
+    private:
+        Int _transformationProjectionMatrixUniform;
+};
+
+InstancedFlatShader::InstancedFlatShader() {
+    Utility::Resource rs("bullet-data");
+
+    #ifndef MAGNUM_TARGET_GLES
+    const GL::Version version = GL::Version::GL330;
+    #elif !defined(MAGNUM_TARGET_GLES2)
+    const GL::Version version = GL::Version::GLES300;
+    #else
+    const GL::Version version = GL::Version::GLES200;
+    #endif
+
+    GL::Shader vert{version, GL::Shader::Type::Vertex},
+        frag{version, GL::Shader::Type::Fragment};
+    #ifndef MAGNUM_TARGET_GLES2
+    vert.addSource("#define NEW_GLSL\n");
+    frag.addSource("#define NEW_GLSL\n");
+    #endif
+    vert.addSource(rs.get("InstancedFlat.vert"));
+    frag.addSource(rs.get("InstancedFlat.frag"));
+    CORRADE_INTERNAL_ASSERT(GL::Shader::compile({vert, frag}));
+    attachShaders({vert, frag});
+
+    bindAttributeLocation(Position::Location, "position");
+    bindAttributeLocation(TransformationMatrix::Location, "instanceTransformation");
+    bindAttributeLocation(Color::Location, "instanceColor");
+    CORRADE_INTERNAL_ASSERT(link());
+
+    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+}
+
+/* A ghost volume spanning the whole world. The broadphase keeps a pair
+   between it and every body inside, and once a body gets out of the
+   bounds, the pair is removed and the body is remembered here. The cost is
+   thus proportional to bodies that left, not to all bodies. */
+class WorldBounds: public btGhostObject {
+    public:
+        explicit WorldBounds(const Vector3& halfExtents): _shape{btVector3{halfExtents}} {
+            setCollisionShape(&_shape);
+            /* Static so it's skipped when syncing bodies */
+            setCollisionFlags(getCollisionFlags()|CF_STATIC_OBJECT|CF_NO_CONTACT_RESPONSE|CF_DISABLE_VISUALIZE_OBJECT);
+        }
+
+        /* Bodies that left the bounds since the last clear */
+        std::vector<btCollisionObject*>& left() { return _left; }
+
+        /* Removing a body from the world removes its pairs as well, that's
+           not a body leaving */
+        void setRecording(bool recording) { _recording = recording; }
+
+        /* The base implementation keeps a list of overlapping objects and
+           does a linear search in it on every removal, which isn't needed
+           here at all */
+        void addOverlappingObjectInternal(btBroadphaseProxy*, btBroadphaseProxy*) override {}
+        void removeOverlappingObjectInternal(btBroadphaseProxy* otherProxy, btDispatcher*, btBroadphaseProxy*) override {
+            if(_recording)
+                _left.push_back(static_cast<btCollisionObject*>(otherProxy->m_clientObject));
+        }
+
+    private:
+        btBoxShape _shape;
+        std::vector<btCollisionObject*> _left;
+        bool _recording{true};
+};
+
+/* Same colors as btCollisionWorld::debugDrawWorld() uses by default. Not
+   taken from btIDebugDraw::DefaultColors, as that's not in older Bullet
+   versions. */
+Color3 debugDrawColor(const btCollisionObject& object) {
+    switch(object.getActivationState()) {
+        case ACTIVE_TAG: return {1.0f, 1.0f, 1.0f};
+        case ISLAND_SLEEPING: return {0.0f, 1.0f, 0.0f};
+        case WANTS_DEACTIVATION: return {0.0f, 1.0f, 1.0f};
+        case DISABLE_DEACTIVATION: return {1.0f, 0.0f, 0.0f};
+        case DISABLE_SIMULATION: return {1.0f, 1.0f, 0.0f};
+        default: return {1.0f, 0.0f, 0.0f};
+    }
+}
+
+/* Pairs with the world bounds need to exist only in the broadphase, skip
+   the narrowphase for them */
+void worldBoundsNearCallback(btBroadphasePair& pair, btCollisionDispatcher& dispatcher, const btDispatcherInfo& info) {
+    if(static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject)->getInternalType() == btCollisionObject::CO_GHOST_OBJECT ||
+       static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject)->getInternalType() == btCollisionObject::CO_GHOST_OBJECT)
+        return;
+    btCollisionDispatcher::defaultNearCallback(pair, dispatcher, info);
+}
+
+class RigidBody;
+class InstancedBody;
+
+typedef SceneGraph::FeatureGroup3D<InstancedBody> InstancedBodyGroup;
+
+/* Poses of all bodies before and after a physics tick, published by the
+   physics thread for the render thread to interpolate between */
+struct PhysicsSnapshot {
+    struct Body {
+        RigidBody* body;
+        Vector3 previousTranslation, translation;
+        Quaternion previousRotation, rotation;
+        /* Whether the body was active before the tick. Bodies that sleep
+           both before and after are not included in the snapshot. */
+        bool wasActive;
+        /* Debug wireframe color for the activation state after the tick */
+        Color3 wireframeColor;
+    };
+
+    std::vector<Body> bodies;
+    /* When the tick finished */
+    std::chrono::steady_clock::time_point time;
+};
+
 class BulletExample: public Platform::Application {
     public:
         explicit BulletExample(const Arguments& arguments);
 
+        ~BulletExample();
+
     private:
         void drawEvent() override;
         void keyPressEvent(KeyEvent& event) override;
         void mousePressEvent(MouseEvent& event) override;
 
+        struct Shot {
+            RigidBody* body;
+            Vector3 origin, direction;
+        };
+
+        void shoot(bool box, const Vector2& position);
+        void shoot(bool box, const Vector3& origin, const Vector3& direction);
+        void launch(const Shot& shot);
+        void applyEvent(const RecordedEvent& event);
+
+        void stepSimulation(Float timeStep, Int maxSubSteps, Float fixedTimeStep);
+        void syncActiveBodies();
+        void physicsLoop();
+        void applySnapshot();
+        void removeFarObjects(std::vector<RigidBody*>& removed);
+        void recycleRemovedBodies();
+        void drawInstanced(InstancedBodyGroup& bodies, GL::Buffer& instanceBuffer, GL::Mesh& mesh, Float scale);
+        void drawWireframes();
+        void addWireframeInstances(InstancedBodyGroup& bodies, Float scale);
+        void uploadInstanceData(GL::Buffer& instanceBuffer, GL::Mesh& mesh);
+
         GL::Mesh _box{NoCreate}, _sphere{NoCreate};
         Shaders::Phong _shader{NoCreate};
+
+        /* Boxes and spheres are drawn with one instanced draw per shape, the
+           ground is a regular drawable */
+        InstancedPhongShader _instancedShader{NoCreate};
+        #ifdef MAGNUM_TARGET_GLES2
+        /* Without instanced arrays each body is drawn separately */
+        bool _instancedArrays;
+        #endif
+        GL::Mesh _boxInstanced{NoCreate}, _sphereInstanced{NoCreate};
+        GL::Buffer _boxInstanceBuffer{NoCreate}, _sphereInstanceBuffer{NoCreate};
+        InstancedBodyGroup _boxes, _spheres;
+
+        /* Bodies that got too far away are removed from the world and their
+           group and put here to be reused by the next shot, instead of being
+           deleted and allocated again */
+        std::vector<InstancedBody*> _freeBoxes, _freeSpheres;
+        /* Bodies removed from the world by removeFarObjects() that weren't
+           put to the free lists yet. With the physics thread, guarded by the
+           snapshot mutex. */
+        std::vector<RigidBody*> _removedBodies;
+        std::size_t _bodyCount{}, _recycledCount{};
+        struct InstanceData {
+            Matrix4 transformation;
+            Color3 color;
+        };
+        std::vector<InstanceData> _instanceData;
+
+        /* Debug wireframes are drawn from a template mesh for each shape,
+           instanced the same way as the solid bodies. Bullet's own debug
+           draw, emitting every line through a virtual call, is used only
+           with --line-debug-draw. */
+        InstancedFlatShader _wireframeShader{NoCreate};
+        GL::Mesh _boxWireframe{NoCreate}, _sphereWireframe{NoCreate};
+        GL::Buffer _boxWireframeBuffer{NoCreate}, _sphereWireframeBuffer{NoCreate};
+        RigidBody* _ground;
+        Matrix4 _groundScaling;
+        bool _lineDebugDraw{};
         BulletIntegration::DebugDraw _debugDraw{NoCreate};
 
+        /* The task scheduler is used only with the multithreaded world */
+        #if BT_BULLET_VERSION >= 288
+        Containers::Pointer<btITaskScheduler> _bTaskScheduler;
+        #endif
+        btGhostPairCallback _bGhostPairCallback;
         btDbvtBroadphase _bBroadphase;
-        btDefaultCollisionConfiguration _bCollisionConfig;
-        btCollisionDispatcher _bDispatcher{&_bCollisionConfig};
-        btSequentialImpulseConstraintSolver _bSolver;
+        WorldBounds _worldBounds{Vector3{100.0f}};
+        Containers::Pointer<btDefaultCollisionConfiguration> _bCollisionConfig;
+        Containers::Pointer<btCollisionDispatcher> _bDispatcher;
+        #if BT_BULLET_VERSION >= 288
+        Containers::Pointer<btConstraintSolverPoolMt> _bSolverPool;
+        #endif
+        Containers::Pointer<btConstraintSolver> _bSolver;
 
         /* The world has to live longer than the scene because RigidBody
            instances have to remove themselves from it on destruction */
-        btDiscreteDynamicsWorld _bWorld{&_bDispatcher, &_bBroadphase, &_bSolver, &_bCollisionConfig};
+        Containers::Pointer<btDiscreteDynamicsWorld> _bWorld;
 
         Scene3D _scene;
         SceneGraph::Camera3D* _camera;
@@ -93,6 +615,62 @@ class BulletExample: public Platform::Application {
         btBoxShape _bGroundShape{{4.0f, 0.5f, 4.0f}};
 
         bool _drawCubes{true}, _drawDebug{true}, _shootBox{true};
+
+        /* Stress mode, shooting given count of objects per second in random
+           directions and reporting allocations every second */
+        Float _stressShotsPerSecond{}, _stressShots{}, _reportDuration{};
+        std::minstd_rand _stressRandom;
+        std::size_t _reportedBulletAllocationCount{}, _reportedBodyCount{},
+            _reportedRecycledCount{}, _shotCount{};
+
+        /* Deterministic mode, stepping exactly one tick each frame. Shots
+           and camera movement are optionally recorded to a file. A replay
+           applies them at the same frames again and runs as fast as
+           possible, optionally without drawing anything. */
+        bool _deterministic{}, _replaying{}, _headless{};
+        std::ofstream _recording;
+        std::vector<RecordedEvent> _replay;
+        std::size_t _replayPosition{};
+        /* Frame index the events are recorded with. Counted on the render
+           thread, in the deterministic mode it's the same as the step
+           count. */
+        std::size_t _frame{};
+        std::chrono::high_resolution_clock::time_point _replayStart;
+        Double _replayStepTime{};
+
+        /* Physics on its own thread, stepping at a fixed tick. Only the
+           physics thread touches the world, holding the world mutex for the
+           whole tick. The render thread takes it only for the line debug
+           draw and on exit. Everything else is exchanged under the snapshot
+           mutex, which is held just for a short time on both sides --- the
+           render thread queues shots to be added at the start of the next
+           tick, the physics thread publishes the poses, bodies removed from
+           the world and the title. Lock order is always world first,
+           snapshot second. */
+        bool _physicsThreadEnabled{};
+        Float _tick{1.0f/60.0f};
+        std::thread _physicsThread;
+        bool _physicsQuit{};
+        std::mutex _worldMutex, _snapshotMutex;
+        PhysicsSnapshot _frontSnapshot, _backSnapshot;
+        std::vector<Shot> _pendingShots;
+
+        /* Step time breakdown. Averaged over a second and shown in the
+           window title, optionally also saved for every frame to a CSV.
+           Prepared under the snapshot mutex, the title is set on the render
+           thread. */
+        std::string _title, _profileTitle;
+        bool _profileTitleChanged{};
+        StepProfile _stepProfile, _averagedStepProfile;
+        std::size_t _averagedFrameCount{}, _stepCount{};
+        std::size_t _activeBodyCount{}, _sleepingBodyCount{};
+        Float _averagedDuration{};
+
+        /* Time left over from the substeps and the time by which the poses
+           are interpolated from the last substep, used when not stepping by
+           a fixed tick */
+        Float _localTime{}, _interpolationTime{};
+        std::ofstream _profileCsv;
 };
 
 class ColoredDrawable: public SceneGraph::Drawable3D {
@@ -116,44 +694,123 @@ class ColoredDrawable: public SceneGraph::Drawable3D {
 
 class RigidBody: public Object3D {
     public:
+        /* There's no motion state, transformations of active bodies are
+           synchronized to the objects in bulk after each step */
         RigidBody(Object3D* parent, Float mass, btCollisionShape* bShape, btDynamicsWorld& bWorld): Object3D{parent}, _bWorld(bWorld) {
             /* Calculate inertia so the object reacts as it should with
                rotation and everything */
             btVector3 bInertia(0.0f, 0.0f, 0.0f);
             if(mass != 0.0f) bShape->calculateLocalInertia(mass, bInertia);
 
-            /* Bullet rigid body setup */
-            auto* motionState = new BulletIntegration::MotionState{*this};
+            /* Bullet rigid body setup. Bodies are allowed to fall asleep once
+               they come to rest and wake up again when something hits them. */
             _bRigidBody.emplace(btRigidBody::btRigidBodyConstructionInfo{
-                mass, &motionState->btMotionState(), bShape, bInertia});
-            _bRigidBody->forceActivationState(DISABLE_DEACTIVATION);
-            bWorld.addRigidBody(_bRigidBody.get());
+                mass, nullptr, bShape, bInertia});
+            _bRigidBody->setUserPointer(this);
         }
 
         ~RigidBody() {
-            _bWorld.removeRigidBody(_bRigidBody.get());
+            if(_inWorld) removeFromWorld();
         }
 
         btRigidBody& rigidBody() { return *_bRigidBody; }
 
+        /* Set by InstancedBody, null for the ground */
+        InstancedBody* instance() { return _instance; }
+        void setInstance(InstancedBody* instance) { _instance = instance; }
+
+        /* The body is not added to the world on construction, so it can be
+           created on the render thread and added on the physics thread.
+           Removal is used for recycling the body without deleting it. */
+        void addToWorld() {
+            _bWorld.addRigidBody(_bRigidBody.get());
+            _inWorld = true;
+        }
+        bool isInWorld() const { return _inWorld; }
+        void removeFromWorld() {
+            _bWorld.removeRigidBody(_bRigidBody.get());
+            _inWorld = false;
+        }
+
         /* needed after changing the pose from Magnum side */
         void syncPose() {
-            _bRigidBody->setWorldTransform(btTransform(transformationMatrix()));
+            setPose(btTransform(transformationMatrix()));
+        }
+
+        /* The interpolation transform is what the poses are interpolated
+           from, so it has to be set as well for the body to not show up at
+           the old pose */
+        void setPose(const btTransform& transform) {
+            _bRigidBody->setWorldTransform(transform);
+            _bRigidBody->setInterpolationWorldTransform(transform);
         }
 
+        /* Debug wireframe color, updated from the snapshots when the physics
+           runs on its own thread */
+        Color3 wireframeColor() const { return _wireframeColor; }
+        void setWireframeColor(const Color3& color) { _wireframeColor = color; }
+
     private:
         btDynamicsWorld& _bWorld;
         Containers::Pointer<btRigidBody> _bRigidBody;
+        bool _inWorld{};
+        InstancedBody* _instance{};
+        Color3 _wireframeColor{1.0f};
+};
+
+/* Marks a rigid body for instanced drawing */
+class InstancedBody: public SceneGraph::AbstractGroupedFeature3D<InstancedBody> {
+    public:
+        explicit InstancedBody(RigidBody& body, const Color3& color, InstancedBodyGroup& group): SceneGraph::AbstractGroupedFeature3D<InstancedBody>{body, &group}, _body(body), _color{color} {
+            body.setInstance(this);
+        }
+
+        RigidBody& body() { return _body; }
+        Color3 color() const { return _color; }
+        void setColor(const Color3& color) { _color = color; }
+
+    private:
+        RigidBody& _body;
+        Color3 _color;
 };
 
 BulletExample::BulletExample(const Arguments& arguments): Platform::Application(arguments, NoCreate) {
+    Utility::Arguments args;
+    args.addOption("boxes", "5").setHelp("boxes", "size of the box cube on the table, i.e. cube of this value boxes", "N")
+        .addBooleanOption("multithreaded").setHelp("multithreaded", "use the multithreaded world and parallel constraint solver")
+        .addOption("threads", "0").setHelp("threads", "thread count for the multithreaded world, 0 means all hardware threads", "N")
+        .addOption("profile-csv").setHelp("profile-csv", "save a step time breakdown for every frame to a CSV file", "file")
+        .addBooleanOption("physics-thread").setHelp("physics-thread", "step the physics on a separate thread and interpolate the poses for rendering")
+        .addOption("tick-rate", "60").setHelp("tick-rate", "physics tick rate in Hz with --physics-thread or --deterministic", "Hz")
+        .addOption("stress", "0").setHelp("stress", "shoot this many objects per second in random directions and report allocations", "N")
+        .addBooleanOption("deterministic").setHelp("deterministic", "step the physics exactly one tick each frame, independently of the frame time")
+        .addOption("record").setHelp("record", "record shots and camera movement to a file, implies --deterministic", "file")
+        .addOption("replay").setHelp("replay", "replay a recording made with --record as fast as possible and print the timing when it ends", "file")
+        .addBooleanOption("line-debug-draw").setHelp("line-debug-draw", "draw the debug wireframes line by line through Bullet instead of instancing them")
+        .addBooleanOption("headless").setHelp("headless", "don't draw anything and hide the window during --replay")
+        .addSkippedPrefix("magnum").setHelp("engine-specific options")
+        .parse(arguments.argc, arguments.argv);
+
+    /* A replay takes the box count and tick duration from the recording */
+    Int boxCount = args.value<Int>("boxes");
+    _tick = 1.0f/args.value<Float>("tick-rate");
+    if(!args.value("replay").empty()) {
+        if(!loadRecording(args.value("replay"), boxCount, _tick, _replay))
+            std::exit(1);
+        _replaying = true;
+        _headless = args.isSet("headless");
+    }
+    _deterministic = _replaying || args.isSet("deterministic") || !args.value("record").empty();
+
     /* Try 8x MSAA, fall back to zero samples if not possible. Enable only 2x
        MSAA if we have enough DPI. */
+    _title = "Magnum Bullet Integration Example";
     {
         const Vector2 dpiScaling = this->dpiScaling({});
         Configuration conf;
-        conf.setTitle("Magnum Bullet Integration Example")
+        conf.setTitle(_title)
             .setSize(conf.size(), dpiScaling);
+        if(_headless) conf.addWindowFlags(Configuration::WindowFlag::Hidden);
         GLConfiguration glConf;
         glConf.setSampleCount(dpiScaling.max() < 2.0f ? 8 : 2);
         if(!tryCreate(conf, glConf))
@@ -179,6 +836,52 @@ BulletExample::BulletExample(const Arguments& arguments): Platform::Application(
     _shader.setAmbientColor(0x111111_rgbf)
            .setSpecularColor(0x330000_rgbf)
            .setLightPosition({10.0f, 15.0f, 5.0f});
+    _boxInstanceBuffer = GL::Buffer{};
+    _sphereInstanceBuffer = GL::Buffer{};
+    _boxInstanced = MeshTools::compile(Primitives::cubeSolid());
+    _sphereInstanced = MeshTools::compile(Primitives::uvSphereSolid(16, 32));
+    #ifdef MAGNUM_TARGET_GLES2
+    _instancedArrays = GL::Context::current().isExtensionSupported<GL::Extensions::ANGLE::instanced_arrays>()
+        #ifndef MAGNUM_TARGET_WEBGL
+        || GL::Context::current().isExtensionSupported<GL::Extensions::EXT::instanced_arrays>()
+        || GL::Context::current().isExtensionSupported<GL::Extensions::NV::instanced_arrays>()
+        #endif
+        ;
+    if(!_instancedArrays)
+        Warning{} << "Instanced arrays are not supported, drawing each body separately";
+    else
+    #endif
+    {
+        _boxInstanced.addVertexBufferInstanced(_boxInstanceBuffer, 1, 0,
+            InstancedPhongShader::TransformationMatrix{},
+            InstancedPhongShader::Color{});
+        _sphereInstanced.addVertexBufferInstanced(_sphereInstanceBuffer, 1, 0,
+            InstancedPhongShader::TransformationMatrix{},
+            InstancedPhongShader::Color{});
+        _instancedShader = InstancedPhongShader{};
+        _instancedShader.setAmbientColor(0x111111_rgbf)
+            .setSpecularColor(0x330000_rgbf)
+            .setLightPosition({10.0f, 15.0f, 5.0f});
+    }
+    _lineDebugDraw = args.isSet("line-debug-draw");
+    /* Without instanced arrays the wireframes fall back to the line debug
+       draw */
+    #ifdef MAGNUM_TARGET_GLES2
+    if(!_instancedArrays) _lineDebugDraw = true;
+    #endif
+    if(!_lineDebugDraw) {
+        _boxWireframeBuffer = GL::Buffer{};
+        _sphereWireframeBuffer = GL::Buffer{};
+        _boxWireframe = MeshTools::compile(Primitives::cubeWireframe());
+        _boxWireframe.addVertexBufferInstanced(_boxWireframeBuffer, 1, 0,
+            InstancedFlatShader::TransformationMatrix{},
+            InstancedFlatShader::Color{});
+        _sphereWireframe = MeshTools::compile(Primitives::uvSphereWireframe(8, 16));
+        _sphereWireframe.addVertexBufferInstanced(_sphereWireframeBuffer, 1, 0,
+            InstancedFlatShader::TransformationMatrix{},
+            InstancedFlatShader::Color{});
+        _wireframeShader = InstancedFlatShader{};
+    }
     _debugDraw = BulletIntegration::DebugDraw{};
     _debugDraw.setMode(BulletIntegration::DebugDraw::Mode::DrawWireframe);
 
@@ -188,54 +891,546 @@ BulletExample::BulletExample(const Arguments& arguments): Platform::Application(
     GL::Renderer::enable(GL::Renderer::Feature::PolygonOffsetFill);
     GL::Renderer::setPolygonOffset(2.0f, 0.5f);
 
-    /* Bullet setup */
-    _bWorld.setGravity({0.0f, -10.0f, 0.0f});
-    _bWorld.setDebugDrawer(&_debugDraw);
+    /* Count what Bullet allocates. Memory allocated before this point is
+       freed by the same std::free(), so it's fine to switch it late. */
+    btAlignedAllocSetCustom(countingBulletAlloc, countingBulletFree);
+
+    /* Bullet setup. The multithreaded world needs Bullet 2.88 built with
+       BT_THREADSAFE, otherwise there's no task scheduler and the world falls
+       back to single-threaded. */
+    #if BT_BULLET_VERSION >= 288
+    if(args.isSet("multithreaded")) {
+        _bTaskScheduler.reset(btCreateDefaultTaskScheduler());
+        if(!_bTaskScheduler)
+            Warning{} << "Bullet is not built with BT_THREADSAFE, using a single-threaded world";
+    }
+    if(_bTaskScheduler) {
+        const Int threadCount = args.value<Int>("threads");
+        _bTaskScheduler->setNumThreads(threadCount ? threadCount : _bTaskScheduler->getMaxNumThreads());
+        btSetTaskScheduler(_bTaskScheduler.get());
+
+        /* The default pool sizes are too small for thousands of bodies */
+        btDefaultCollisionConstructionInfo collisionInfo;
+        collisionInfo.m_defaultMaxPersistentManifoldPoolSize = 80000;
+        collisionInfo.m_defaultMaxCollisionAlgorithmPoolSize = 80000;
+        _bCollisionConfig.reset(new btDefaultCollisionConfiguration{collisionInfo});
+        _bDispatcher.reset(new btCollisionDispatcherMt{_bCollisionConfig.get(), 40});
+        _bSolverPool.reset(new btConstraintSolverPoolMt{_bTaskScheduler->getNumThreads()});
+        _bSolver.reset(new btSequentialImpulseConstraintSolverMt);
+        _bWorld.reset(new btDiscreteDynamicsWorldMt{_bDispatcher.get(), &_bBroadphase, _bSolverPool.get(), _bSolver.get(), _bCollisionConfig.get()});
+        _title += Utility::format(" ({} threads)", _bTaskScheduler->getNumThreads());
+    } else
+    #else
+    if(args.isSet("multithreaded"))
+        Warning{} << "The multithreaded world needs Bullet 2.88, using a single-threaded world";
+    #endif
+    {
+        _bCollisionConfig.reset(new btDefaultCollisionConfiguration);
+        _bDispatcher.reset(new btCollisionDispatcher{_bCollisionConfig.get()});
+        _bSolver.reset(new btSequentialImpulseConstraintSolver);
+        _bWorld.reset(new btDiscreteDynamicsWorld{_bDispatcher.get(), &_bBroadphase, _bSolver.get(), _bCollisionConfig.get()});
+    }
+    _bWorld->setGravity({0.0f, -10.0f, 0.0f});
+    _bWorld->setDebugDrawer(&_debugDraw);
+
+    /* Bodies that get too far are recycled, detected through the world
+       bounds ghost. The ghost collides only with dynamic bodies. */
+    _bBroadphase.getOverlappingPairCache()->setInternalGhostPairCallback(&_bGhostPairCallback);
+    _bDispatcher->setNearCallback(worldBoundsNearCallback);
+    _bWorld->addCollisionObject(&_worldBounds, btBroadphaseProxy::SensorTrigger,
+        btBroadphaseProxy::AllFilter & ~(btBroadphaseProxy::StaticFilter|btBroadphaseProxy::SensorTrigger));
 
-    /* Create the ground */
-    auto* ground = new RigidBody{&_scene, 0.0f, &_bGroundShape, _bWorld};
-    new ColoredDrawable{*ground, _shader, _box, 0xffffff_rgbf,
-        Matrix4::scaling({4.0f, 0.5f, 4.0f}), _drawables};
+    /* Step time breakdown */
+    #if BT_BULLET_VERSION >= 286
+    btSetCustomEnterProfileZoneFunc(enterProfileZone);
+    btSetCustomLeaveProfileZoneFunc(leaveProfileZone);
+    #endif
+    if(!args.value("profile-csv").empty()) {
+        _profileCsv.open(args.value("profile-csv"));
+        _profileCsv << "frame,bodies,active,sleeping,broadphase,narrowphase,solver,integration,sync,total\n";
+    }
+
+    /* The physics thread ticks based on wall clock, so it can't be
+       deterministic. Replayed shots are in the recording already. */
+    _physicsThreadEnabled = args.isSet("physics-thread");
+    if(_physicsThreadEnabled && _deterministic) {
+        Warning{} << "The physics thread is not deterministic, stepping the physics on the render thread";
+        _physicsThreadEnabled = false;
+    }
+    if(!_replaying) _stressShotsPerSecond = args.value<Float>("stress");
+    if(_physicsThreadEnabled || _deterministic)
+        _title += Utility::format(", physics at {} Hz", 1.0f/_tick);
+
+    if(!args.value("record").empty()) {
+        _recording.open(args.value("record"), std::ios::binary);
+        if(!_recording) {
+            Error{} << "Can't open" << args.value("record") << "for writing";
+            std::exit(1);
+        }
+        _recording.write(RecordingMagic, sizeof(RecordingMagic));
+        writeRecorded(_recording, RecordingVersion);
+        writeRecorded(_recording, boxCount);
+        writeRecorded(_recording, _tick);
+    }
+
+    /* Create the ground, larger if there's more boxes */
+    const Float groundScale = Math::max(1.0f, boxCount/5.0f);
+    _bGroundShape.setLocalScaling({groundScale, 1.0f, groundScale});
+    _ground = new RigidBody{&_scene, 0.0f, &_bGroundShape, *_bWorld};
+    _ground->addToWorld();
+    _ground->setWireframeColor(debugDrawColor(_ground->rigidBody()));
+    _groundScaling = Matrix4::scaling({4.0f*groundScale, 0.5f, 4.0f*groundScale});
+    new ColoredDrawable{*_ground, _shader, _box, 0xffffff_rgbf,
+        _groundScaling, _drawables};
 
     /* Create boxes with random colors */
     Deg hue = 42.0_degf;
-    for(Int i = 0; i != 5; ++i) {
-        for(Int j = 0; j != 5; ++j) {
-            for(Int k = 0; k != 5; ++k) {
-                auto* o = new RigidBody{&_scene, 1.0f, &_bBoxShape, _bWorld};
-                o->translate({i - 2.0f, j + 4.0f, k - 2.0f});
+    const Float offset = (boxCount - 1)*0.5f;
+    for(Int i = 0; i != boxCount; ++i) {
+        for(Int j = 0; j != boxCount; ++j) {
+            for(Int k = 0; k != boxCount; ++k) {
+                auto* o = new RigidBody{&_scene, 1.0f, &_bBoxShape, *_bWorld};
+                ++_bodyCount;
+                o->translate({i - offset, j + 4.0f, k - offset});
                 o->syncPose();
-                new ColoredDrawable{*o, _shader, _box,
-                    Color3::fromHsv(hue += 137.5_degf, 0.75f, 0.9f),
-                    Matrix4::scaling(Vector3{0.5f}), _drawables};
+                o->addToWorld();
+                new InstancedBody{*o,
+                    Color3::fromHsv(hue += 137.5_degf, 0.75f, 0.9f), _boxes};
             }
         }
     }
 
-    /* Loop at 60 Hz max */
-    setSwapInterval(1);
-    setMinimalLoopPeriod(16);
+    /* Loop at 60 Hz max, replay as fast as possible */
+    if(_replaying) {
+        setSwapInterval(0);
+        _replayStart = std::chrono::high_resolution_clock::now();
+    } else {
+        setSwapInterval(1);
+        setMinimalLoopPeriod(16);
+    }
     _timeline.start();
+
+    if(_physicsThreadEnabled)
+        _physicsThread = std::thread{&BulletExample::physicsLoop, this};
+}
+
+BulletExample::~BulletExample() {
+    if(_physicsThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock{_worldMutex};
+            _physicsQuit = true;
+        }
+        _physicsThread.join();
+    }
+
+    if(_recording.is_open())
+        writeRecordedEvent(_recording, {UnsignedInt(_frame), RecordedEventType::End, {}, {}, 0.0f});
+
+    #if BT_BULLET_VERSION >= 286
+    btSetCustomEnterProfileZoneFunc(btEnterProfileZoneDefault);
+    btSetCustomLeaveProfileZoneFunc(btLeaveProfileZoneDefault);
+    #endif
+    #if BT_BULLET_VERSION >= 288
+    if(_bTaskScheduler) btSetTaskScheduler(nullptr);
+    #endif
+}
+
+void BulletExample::stepSimulation(const Float timeStep, const Int maxSubSteps, const Float fixedTimeStep) {
+    _stepProfile = {};
+    #if BT_BULLET_VERSION >= 286
+    currentProfile = &_stepProfile;
+    profiledThread = std::this_thread::get_id();
+    #endif
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    _bWorld->stepSimulation(timeStep, maxSubSteps, fixedTimeStep);
+
+    /* Bullet keeps the time left over from the substeps for the next step,
+       mirror it for interpolating the poses */
+    _localTime = std::fmod(_localTime + timeStep, fixedTimeStep);
+    _interpolationTime = _localTime - fixedTimeStep;
+
+    /* Bullet's own synchronizeMotionStates() has nothing to do as there are
+       no motion states, so the bulk sync is measured as the sync phase */
+    const auto syncStart = std::chrono::high_resolution_clock::now();
+    syncActiveBodies();
+    _stepProfile.time[StepProfile::Sync] = std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - syncStart).count();
+    _stepProfile.time[StepProfile::Total] = std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    #if BT_BULLET_VERSION >= 286
+    currentProfile = nullptr;
+    #endif
+
+    if(_profileCsv.is_open()) {
+        _profileCsv << _stepCount << ',' << _bWorld->getNumCollisionObjects()
+            << ',' << _activeBodyCount << ',' << _sleepingBodyCount;
+        for(Double time: _stepProfile.time) _profileCsv << ',' << time;
+        _profileCsv << '\n';
+    }
+    ++_stepCount;
+
+    /* Show the average in the window title once a second. The window title
+       can be changed only from the render thread, so it's just prepared
+       here. */
+    _averagedStepProfile += _stepProfile;
+    ++_averagedFrameCount;
+    if((_averagedDuration += timeStep) >= 1.0f) {
+        const Double* const time = _averagedStepProfile.time;
+        const Double n = _averagedFrameCount;
+        std::lock_guard<std::mutex> lock{_snapshotMutex};
+        _profileTitle = Utility::format("{} | {} bodies ({} active, {} sleeping), step {:.2f} ms: broadphase {:.2f}, narrowphase {:.2f}, solver {:.2f}, integration {:.2f}, sync {:.2f}",
+            _title, _bWorld->getNumCollisionObjects(),
+            _activeBodyCount, _sleepingBodyCount,
+            time[StepProfile::Total]/n,
+            time[StepProfile::Broadphase]/n,
+            time[StepProfile::Narrowphase]/n,
+            time[StepProfile::Solver]/n,
+            time[StepProfile::Integration]/n,
+            time[StepProfile::Sync]/n);
+        _profileTitleChanged = true;
+        _averagedStepProfile = {};
+        _averagedFrameCount = 0;
+        _averagedDuration = 0.0f;
+    }
+}
+
+void BulletExample::syncActiveBodies() {
+    const btCollisionObjectArray& objects = _bWorld->getCollisionObjectArray();
+    _activeBodyCount = _sleepingBodyCount = 0;
+
+    /* With a physics thread, put all bodies that moved during the tick to
+       the snapshot, compacting it in place */
+    if(_physicsThreadEnabled) {
+        std::vector<PhysicsSnapshot::Body>& bodies = _backSnapshot.bodies;
+        std::size_t count = 0;
+        for(Int i = 0; i != objects.size(); ++i) {
+            const btCollisionObject& object = *objects[i];
+            if(object.isStaticOrKinematicObject()) continue;
+
+            const bool active = object.isActive();
+            if(active) ++_activeBodyCount;
+            else ++_sleepingBodyCount;
+
+            /* A body that woke up during the tick has no pose from before
+               it, so it's shown at the new pose right away */
+            PhysicsSnapshot::Body& body = bodies[i];
+            if(!active && !body.wasActive) continue;
+            const btTransform& transform = object.getWorldTransform();
+            body.translation = Vector3{transform.getOrigin()};
+            body.rotation = Quaternion{transform.getRotation()};
+            body.wireframeColor = debugDrawColor(object);
+            if(!body.wasActive) {
+                body.body = static_cast<RigidBody*>(object.getUserPointer());
+                body.previousTranslation = body.translation;
+                body.previousRotation = body.rotation;
+            }
+            bodies[count++] = body;
+        }
+        bodies.resize(count);
+
+    /* Otherwise update the objects directly. Sleeping bodies don't move, so
+       they're skipped. */
+    } else for(Int i = 0; i != objects.size(); ++i) {
+        const btCollisionObject& object = *objects[i];
+        if(object.isStaticOrKinematicObject()) continue;
+
+        if(!object.isActive()) {
+            ++_sleepingBodyCount;
+            continue;
+        }
+
+        ++_activeBodyCount;
+
+        /* In the deterministic mode each frame is exactly one step, so the
+           pose after it is used directly */
+        RigidBody& body = *static_cast<RigidBody*>(object.getUserPointer());
+        if(_deterministic) {
+            body.setTransformation(Matrix4{object.getWorldTransform()});
+            continue;
+        }
+
+        /* Otherwise a frame has a varying number of substeps, so interpolate
+           between the last two the same way Bullet does for motion states */
+        btTransform transform;
+        btTransformUtil::integrateTransform(
+            object.getInterpolationWorldTransform(),
+            object.getInterpolationLinearVelocity(),
+            object.getInterpolationAngularVelocity(),
+            _interpolationTime, transform);
+        body.setTransformation(Matrix4{transform});
+    }
+}
+
+void BulletExample::physicsLoop() {
+    const auto tick = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<Float>{_tick});
+    auto next = std::chrono::steady_clock::now();
+    std::vector<Shot> shots;
+    std::vector<RigidBody*> removed;
+    for(;;) {
+        {
+            std::lock_guard<std::mutex> lock{_worldMutex};
+            if(_physicsQuit) break;
+
+            /* Add bodies shot since the last tick */
+            {
+                std::lock_guard<std::mutex> snapshotLock{_snapshotMutex};
+                std::swap(shots, _pendingShots);
+            }
+            for(const Shot& shot: shots) launch(shot);
+            shots.clear();
+
+            /* Remember poses of active bodies before the tick, step exactly
+               one tick. Poses after are filled in syncActiveBodies(). */
+            const btCollisionObjectArray& objects = _bWorld->getCollisionObjectArray();
+            _backSnapshot.bodies.resize(objects.size());
+            for(Int i = 0; i != objects.size(); ++i) {
+                PhysicsSnapshot::Body& body = _backSnapshot.bodies[i];
+                body.wasActive = !objects[i]->isStaticOrKinematicObject() && objects[i]->isActive();
+                if(!body.wasActive) continue;
+
+                const btTransform& transform = objects[i]->getWorldTransform();
+                body.body = static_cast<RigidBody*>(objects[i]->getUserPointer());
+                body.previousTranslation = Vector3{transform.getOrigin()};
+                body.previousRotation = Quaternion{transform.getRotation()};
+            }
+
+            stepSimulation(_tick, 1, _tick);
+            _backSnapshot.time = std::chrono::steady_clock::now();
+
+            /* Bodies removed from the world can't be in the snapshot, as the
+               render thread may reuse them for a shot right away */
+            removeFarObjects(removed);
+            std::vector<PhysicsSnapshot::Body>& bodies = _backSnapshot.bodies;
+            for(RigidBody* body: removed) {
+                for(std::size_t i = 0; i != bodies.size(); ++i) if(bodies[i].body == body) {
+                    bodies.erase(bodies.begin() + i);
+                    break;
+                }
+            }
+
+            std::lock_guard<std::mutex> snapshotLock{_snapshotMutex};
+            std::swap(_frontSnapshot, _backSnapshot);
+            _removedBodies.insert(_removedBodies.end(), removed.begin(), removed.end());
+            removed.clear();
+        }
+
+        /* If the tick took longer than it should, don't try to catch up */
+        next = std::max(next + tick, std::chrono::steady_clock::now() - tick);
+        std::this_thread::sleep_until(next);
+    }
+}
+
+void BulletExample::applySnapshot() {
+    std::lock_guard<std::mutex> lock{_snapshotMutex};
+
+    /* The render thread is one tick behind the physics, so there's always
+       a pose to interpolate towards. Right when a tick finishes, the pose
+       before it is shown, one tick later the pose after. */
+    const Float t = Math::clamp(std::chrono::duration<Float>(std::chrono::steady_clock::now() - _frontSnapshot.time).count()/_tick, 0.0f, 1.0f);
+    for(const PhysicsSnapshot::Body& body: _frontSnapshot.bodies) {
+        const Vector3 translation = Math::lerp(body.previousTranslation, body.translation, t);
+        const Quaternion rotation = Math::slerpShortestPath(body.previousRotation, body.rotation, t);
+        body.body->setTransformation(Matrix4::from(rotation.toMatrix(), translation));
+        body.body->setWireframeColor(body.wireframeColor);
+    }
+
+    recycleRemovedBodies();
+}
+
+void BulletExample::removeFarObjects(std::vector<RigidBody*>& removed) {
+    /* Housekeeping: remove objects that left the world bounds. Their
+       removal from the world isn't recorded as leaving. */
+    std::vector<btCollisionObject*>& left = _worldBounds.left();
+    _worldBounds.setRecording(false);
+    for(btCollisionObject* object: left) {
+        /* A body might be there twice if it came back and left again, and
+           the ground has no instance */
+        RigidBody& body = *static_cast<RigidBody*>(object->getUserPointer());
+        if(!body.instance() || !body.isInWorld()) continue;
+
+        body.removeFromWorld();
+        removed.push_back(&body);
+    }
+    left.clear();
+    _worldBounds.setRecording(true);
+}
+
+void BulletExample::recycleRemovedBodies() {
+    /* Put the removed bodies to the free lists to be reused by next shots */
+    for(RigidBody* body: _removedBodies) {
+        InstancedBody& instance = *body->instance();
+        InstancedBodyGroup& group = *instance.group();
+        group.remove(instance);
+        (&group == &_boxes ? _freeBoxes : _freeSpheres).push_back(&instance);
+    }
+    _removedBodies.clear();
+}
+
+void BulletExample::drawInstanced(InstancedBodyGroup& bodies, GL::Buffer& instanceBuffer, GL::Mesh& mesh, const Float scale) {
+    if(bodies.isEmpty()) return;
+
+    #ifdef MAGNUM_TARGET_GLES2
+    if(!_instancedArrays) {
+        _shader.setProjectionMatrix(_camera->projectionMatrix());
+        for(std::size_t i = 0; i != bodies.size(); ++i) {
+            const Matrix4 transformation = _camera->cameraMatrix()*
+                bodies[i].body().transformationMatrix()*
+                Matrix4::scaling(Vector3{scale});
+            _shader.setDiffuseColor(bodies[i].color())
+                .setTransformationMatrix(transformation)
+                .setNormalMatrix(transformation.rotationScaling());
+            mesh.draw(_shader);
+        }
+        return;
+    }
+    #endif
+
+    /* All bodies are direct children of the scene, so their transformation
+       is what the motion state (or the snapshot interpolation) wrote there,
+       there's no need to go through the scene graph. The primitive scaling
+       is baked in. */
+    _instanceData.resize(bodies.size());
+    for(std::size_t i = 0; i != bodies.size(); ++i) {
+        InstancedBody& instance = bodies[i];
+        Matrix4 transformation = instance.body().transformationMatrix();
+        transformation[0] *= scale;
+        transformation[1] *= scale;
+        transformation[2] *= scale;
+        _instanceData[i] = {transformation, instance.color()};
+    }
+
+    uploadInstanceData(instanceBuffer, mesh);
+    mesh.draw(_instancedShader);
+}
+
+void BulletExample::drawWireframes() {
+    /* The ground is a box as well */
+    _instanceData.clear();
+    _instanceData.push_back({_ground->transformationMatrix()*_groundScaling, _ground->wireframeColor()});
+    addWireframeInstances(_boxes, 0.5f);
+    uploadInstanceData(_boxWireframeBuffer, _boxWireframe);
+    _boxWireframe.draw(_wireframeShader);
+
+    if(_spheres.isEmpty()) return;
+    _instanceData.clear();
+    addWireframeInstances(_spheres, 0.25f);
+    uploadInstanceData(_sphereWireframeBuffer, _sphereWireframe);
+    _sphereWireframe.draw(_wireframeShader);
+}
+
+void BulletExample::addWireframeInstances(InstancedBodyGroup& bodies, const Float scale) {
+    for(std::size_t i = 0; i != bodies.size(); ++i) {
+        RigidBody& body = bodies[i].body();
+        Matrix4 transformation = body.transformationMatrix();
+        transformation[0] *= scale;
+        transformation[1] *= scale;
+        transformation[2] *= scale;
+        /* Bullet updates the activation states during the tick, so with
+           the physics thread they're taken from the snapshot instead */
+        _instanceData.push_back({transformation, _physicsThreadEnabled ?
+            body.wireframeColor() : debugDrawColor(body.rigidBody())});
+    }
+}
+
+void BulletExample::uploadInstanceData(GL::Buffer& instanceBuffer, GL::Mesh& mesh) {
+    /* Orphan the previous contents, the GPU might still be using them */
+    instanceBuffer.setData({nullptr, _instanceData.size()*sizeof(InstanceData)}, GL::BufferUsage::StreamDraw);
+    instanceBuffer.setSubData(0, Containers::arrayView(_instanceData.data(), _instanceData.size()));
+    mesh.setInstanceCount(Int(_instanceData.size()));
 }
 
 void BulletExample::drawEvent() {
-    GL::defaultFramebuffer.clear(GL::FramebufferClear::Color|GL::FramebufferClear::Depth);
+    /* Apply events recorded for this frame, print the timing and exit once
+       the whole recording is replayed */
+    if(_replaying) {
+        for(; _replay[_replayPosition].frame <= _frame; ++_replayPosition) {
+            if(_replay[_replayPosition].type != RecordedEventType::End) {
+                applyEvent(_replay[_replayPosition]);
+                continue;
+            }
 
-    /* Housekeeping: remove any objects which are far away from the origin */
-    for(Object3D* obj = _scene.children().first(); obj; )
-    {
-        Object3D* next = obj->nextSibling();
-        if(obj->transformation().translation().dot() > 100*100)
-            delete obj;
+            const Double duration = std::chrono::duration<Double>(std::chrono::high_resolution_clock::now() - _replayStart).count();
+            const Double frameCount = Math::max(_frame, std::size_t{1});
+            Debug{} << Utility::format("Replayed {} frames in {:.2f} s, {:.3f} ms per frame, of that {:.3f} ms stepping the physics",
+                _frame, duration, duration*1000.0/frameCount, _replayStepTime/frameCount);
+            exit();
+            return;
+        }
+    }
+
+    if(!_headless)
+        GL::defaultFramebuffer.clear(GL::FramebufferClear::Color|GL::FramebufferClear::Depth);
 
-        obj = next;
+    /* Stress mode, shoot as many objects as fit into this frame. In the
+       deterministic mode each frame is exactly one tick. */
+    if(_stressShotsPerSecond) {
+        std::uniform_real_distribution<Float> position;
+        _stressShots += _stressShotsPerSecond*(_deterministic ? _tick : _timeline.previousFrameDuration());
+        for(; _stressShots >= 1.0f; _stressShots -= 1.0f)
+            shoot(_shotCount % 2 == 0, {position(_stressRandom), position(_stressRandom)});
+
+        /* Report allocations once a second */
+        if((_reportDuration += _timeline.previousFrameDuration()) >= 1.0f) {
+            const std::size_t bulletAllocations = bulletAllocationCount;
+            Debug{} << _shotCount << "shots," << _boxes.size() + _spheres.size()
+                << "bodies in the world," << _freeBoxes.size() + _freeSpheres.size()
+                << "free for reuse. In the last second:"
+                << _bodyCount - _reportedBodyCount << "new bodies,"
+                << _recycledCount - _reportedRecycledCount << "recycled,"
+                << bulletAllocations - _reportedBulletAllocationCount << "Bullet allocations";
+            _reportedBodyCount = _bodyCount;
+            _reportedRecycledCount = _recycledCount;
+            _reportedBulletAllocationCount = bulletAllocations;
+            _reportDuration = 0.0f;
+        }
     }
 
-    /* Step bullet simulation */
-    _bWorld.stepSimulation(_timeline.previousFrameDuration(), 5);
+    /* Step bullet simulation, or just interpolate the latest poses if it
+       runs on its own thread */
+    if(_physicsThreadEnabled) applySnapshot();
+    else if(_deterministic) stepSimulation(_tick, 1, _tick);
+    else stepSimulation(_timeline.previousFrameDuration(), 5, 1.0f/60.0f);
+    if(_replaying) _replayStepTime += _stepProfile.time[StepProfile::Total];
+    ++_frame;
 
-    /* Draw the cubes */
-    if(_drawCubes) _camera->draw(_drawables);
+    /* Done after the step so all shots of a frame, both from the input and
+       the stress mode, happen before it also when replaying. The physics
+       thread does that on its own after each tick. */
+    if(!_physicsThreadEnabled) {
+        removeFarObjects(_removedBodies);
+        recycleRemovedBodies();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_snapshotMutex};
+        if(_profileTitleChanged) {
+            setWindowTitle(_profileTitle);
+            _profileTitleChanged = false;
+        }
+    }
+
+    /* A headless replay measures just the physics */
+    if(_headless) {
+        _timeline.nextFrame();
+        redraw();
+        return;
+    }
+
+    /* Draw the ground and then all boxes and spheres, each in a single
+       instanced draw */
+    if(_drawCubes) {
+        _camera->draw(_drawables);
+        #ifdef MAGNUM_TARGET_GLES2
+        if(_instancedArrays)
+        #endif
+        {
+            _instancedShader
+                .setViewMatrix(_camera->cameraMatrix())
+                .setProjectionMatrix(_camera->projectionMatrix());
+        }
+        drawInstanced(_boxes, _boxInstanceBuffer, _boxInstanced, 0.5f);
+        drawInstanced(_spheres, _sphereInstanceBuffer, _sphereInstanced, 0.25f);
+    }
 
     /* Debug draw. If drawing on top of cubes, avoid flickering by setting
        depth function to <= instead of just <. */
@@ -243,9 +1438,17 @@ void BulletExample::drawEvent() {
         if(_drawCubes)
             GL::Renderer::setDepthFunction(GL::Renderer::DepthFunction::LessOrEqual);
 
-        _debugDraw.setTransformationProjectionMatrix(
-            _camera->projectionMatrix()*_camera->cameraMatrix());
-        _bWorld.debugDrawWorld();
+        if(_lineDebugDraw) {
+            /* This blocks until the physics thread finishes its tick */
+            _debugDraw.setTransformationProjectionMatrix(
+                _camera->projectionMatrix()*_camera->cameraMatrix());
+            std::lock_guard<std::mutex> lock{_worldMutex};
+            _bWorld->debugDrawWorld();
+        } else {
+            _wireframeShader.setTransformationProjectionMatrix(
+                _camera->projectionMatrix()*_camera->cameraMatrix());
+            drawWireframes();
+        }
 
         if(_drawCubes)
             GL::Renderer::setDepthFunction(GL::Renderer::DepthFunction::Less);
@@ -257,15 +1460,15 @@ void BulletExample::drawEvent() {
 }
 
 void BulletExample::keyPressEvent(KeyEvent& event) {
-    /* Movement */
+    /* Movement. Ignored in a replay, which moves the camera itself. */
     if(event.key() == KeyEvent::Key::Down) {
-        _cameraObject->rotateX(5.0_degf);
+        if(!_replaying) applyEvent({UnsignedInt(_frame), RecordedEventType::RotateCameraX, {}, {}, 5.0f});
     } else if(event.key() == KeyEvent::Key::Up) {
-        _cameraObject->rotateX(-5.0_degf);
+        if(!_replaying) applyEvent({UnsignedInt(_frame), RecordedEventType::RotateCameraX, {}, {}, -5.0f});
     } else if(event.key() == KeyEvent::Key::Left) {
-        _cameraRig->rotateY(-5.0_degf);
+        if(!_replaying) applyEvent({UnsignedInt(_frame), RecordedEventType::RotateCameraY, {}, {}, -5.0f});
     } else if(event.key() == KeyEvent::Key::Right) {
-        _cameraRig->rotateY(5.0_degf);
+        if(!_replaying) applyEvent({UnsignedInt(_frame), RecordedEventType::RotateCameraY, {}, {}, 5.0f});
 
     /* Toggling draw modes */
     } else if(event.key() == KeyEvent::Key::D) {
@@ -288,31 +1491,98 @@ void BulletExample::keyPressEvent(KeyEvent& event) {
 }
 
 void BulletExample::mousePressEvent(MouseEvent& event) {
-    /* Shoot an object on click */
-    if(event.button() == MouseEvent::Button::Left) {
-        const Vector2 clickPoint = Vector2::yScale(-1.0f)*(Vector2{event.position()}/Vector2{GL::defaultFramebuffer.viewport().size()} - Vector2{0.5f})* _camera->projectionSize();
-        const Vector3 direction = (_cameraObject->absoluteTransformation().rotationScaling()*Vector3{clickPoint, -1.0f}).normalized();
+    /* Shoot an object on click, unless replaying */
+    if(event.button() == MouseEvent::Button::Left && !_replaying) {
+        shoot(_shootBox, Vector2{event.position()}/Vector2{GL::defaultFramebuffer.viewport().size()});
+        event.setAccepted();
+    }
+}
+
+void BulletExample::applyEvent(const RecordedEvent& event) {
+    if(_recording.is_open()) writeRecordedEvent(_recording, event);
+
+    switch(event.type) {
+        case RecordedEventType::ShootBox:
+        case RecordedEventType::ShootSphere:
+            shoot(event.type == RecordedEventType::ShootBox, event.origin, event.direction);
+            break;
+        case RecordedEventType::RotateCameraX:
+            _cameraObject->rotateX(Deg{event.angle});
+            break;
+        case RecordedEventType::RotateCameraY:
+            _cameraRig->rotateY(Deg{event.angle});
+            break;
+        case RecordedEventType::End:
+            break;
+    }
+}
+
+void BulletExample::shoot(const bool box, const Vector2& position) {
+    /* The shot is recorded in world space, so a replay doesn't depend on
+       the window size */
+    const Vector2 clickPoint = Vector2::yScale(-1.0f)*(position - Vector2{0.5f})* _camera->projectionSize();
+    const Vector3 direction = (_cameraObject->absoluteTransformation().rotationScaling()*Vector3{clickPoint, -1.0f}).normalized();
+    applyEvent({UnsignedInt(_frame),
+        box ? RecordedEventType::ShootBox : RecordedEventType::ShootSphere,
+        _cameraObject->absoluteTransformation().translation(), direction, 0.0f});
+}
 
-        auto* object = new RigidBody{
+void BulletExample::shoot(const bool box, const Vector3& origin, const Vector3& direction) {
+    const Color3 color = box ? 0x880000_rgbf : 0x220000_rgbf;
+
+    /* Reuse a recycled body of the same shape, if there's any */
+    std::vector<InstancedBody*>& freeList = box ? _freeBoxes : _freeSpheres;
+    RigidBody* object;
+    if(!freeList.empty()) {
+        InstancedBody& instance = *freeList.back();
+        freeList.pop_back();
+        instance.setColor(color);
+        (box ? _boxes : _spheres).add(instance);
+
+        object = &instance.body();
+        object->resetTransformation()
+            .translate(origin);
+        ++_recycledCount;
+
+    /* Otherwise create a new one */
+    } else {
+        object = new RigidBody{
             &_scene,
-            _shootBox ? 1.0f : 5.0f,
-            _shootBox ? static_cast<btCollisionShape*>(&_bBoxShape) : &_bSphereShape,
-            _bWorld};
-        object->translate(_cameraObject->absoluteTransformation().translation());
-        /* Has to be done explicitly after the translate() above, as Magnum ->
-           Bullet updates are implicitly done only for kinematic bodies */
-        object->syncPose();
+            box ? 1.0f : 5.0f,
+            box ? static_cast<btCollisionShape*>(&_bBoxShape) : &_bSphereShape,
+            *_bWorld};
+        object->translate(origin);
 
         /* Create either a box or a sphere */
-        new ColoredDrawable{*object, _shader, _shootBox ? _box : _sphere,
-            _shootBox ? 0x880000_rgbf : 0x220000_rgbf,
-            Matrix4::scaling(Vector3{_shootBox ? 0.5f : 0.25f}), _drawables};
+        new InstancedBody{*object, color, box ? _boxes : _spheres};
+        ++_bodyCount;
+    }
+    object->setWireframeColor(Color3{1.0f});
+    ++_shotCount;
 
-        /* Give it an initial velocity */
-        object->rigidBody().setLinearVelocity(btVector3{direction*25.f});
+    /* Can't add a body while the physics thread is in the middle of a
+       tick, so it's added at the start of the next one */
+    if(_physicsThreadEnabled) {
+        std::lock_guard<std::mutex> lock{_snapshotMutex};
+        _pendingShots.push_back({object, origin, direction});
+    } else launch({object, origin, direction});
+}
 
-        event.setAccepted();
-    }
+void BulletExample::launch(const Shot& shot) {
+    /* The pose has to be set before the body is added to the world. A
+       recycled body has to have its velocities and forces reset. */
+    btRigidBody& rigidBody = shot.body->rigidBody();
+    shot.body->setPose(btTransform(Matrix4::translation(shot.origin)));
+    rigidBody.setAngularVelocity(btVector3{0.0f, 0.0f, 0.0f});
+    rigidBody.setInterpolationLinearVelocity(btVector3{0.0f, 0.0f, 0.0f});
+    rigidBody.setInterpolationAngularVelocity(btVector3{0.0f, 0.0f, 0.0f});
+    rigidBody.clearForces();
+    shot.body->addToWorld();
+
+    /* Give it an initial velocity. Setting the velocity doesn't wake the
+       body up, so do that explicitly. */
+    rigidBody.setLinearVelocity(btVector3{shot.direction*25.f});
+    rigidBody.activate(true);
 }
 
 }}
@@ -0,0 +1,68 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NEW_GLSL
+#define in varying
+#define fragmentColor gl_FragColor
+#endif
+
+uniform lowp vec3 ambientColor;
+uniform lowp vec3 specularColor;
+uniform mediump float shininess;
+
+in mediump vec3 transformedNormal;
+in highp vec3 lightDirection;
+in highp vec3 cameraDirection;
+in lowp vec3 color;
+
+#ifdef NEW_GLSL
+out lowp vec4 fragmentColor;
+#endif
+
+void main() {
+    mediump vec3 normalizedTransformedNormal = normalize(transformedNormal);
+    highp vec3 normalizedLightDirection = normalize(lightDirection);
+
+    /* Add ambient color */
+    fragmentColor.rgb = ambientColor;
+
+    /* Add diffuse color */
+    lowp float intensity = max(0.0, dot(normalizedTransformedNormal, normalizedLightDirection));
+    fragmentColor.rgb += color*intensity;
+
+    /* Add specular color, if needed */
+    if(intensity > 0.001) {
+        highp vec3 reflection = reflect(-normalizedLightDirection, normalizedTransformedNormal);
+        mediump float specularity = pow(max(0.0, dot(normalize(cameraDirection), reflection)), shininess);
+        fragmentColor.rgb += specularColor*specularity;
+    }
+
+    /* Force alpha to 1 */
+    fragmentColor.a = 1.0;
+}
@@ -0,0 +1,72 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef NEW_GLSL
+#define in attribute
+#define out varying
+#endif
+
+uniform highp mat4 viewMatrix;
+uniform highp mat4 projectionMatrix;
+uniform highp vec3 lightPosition;
+
+in highp vec4 position;
+in mediump vec3 normal;
+
+/* Per-instance world transformation, including the primitive scaling */
+in highp mat4 instanceTransformation;
+in lowp vec3 instanceColor;
+
+out mediump vec3 transformedNormal;
+out highp vec3 lightDirection;
+out highp vec3 cameraDirection;
+out lowp vec3 color;
+
+void main() {
+    /* Transformed vertex position */
+    highp mat4 transformation = viewMatrix*instanceTransformation;
+    highp vec4 transformedPosition4 = transformation*position;
+    highp vec3 transformedPosition = transformedPosition4.xyz/transformedPosition4.w;
+
+    /* Transformed normal vector. Instances are scaled uniformly so there's
+       no need for the inverse transpose, the normal is renormalized in the
+       fragment shader anyway. */
+    transformedNormal = mat3(transformation)*normal;
+
+    /* Direction to the light */
+    lightDirection = normalize(lightPosition - transformedPosition);
+
+    /* Direction to the camera */
+    cameraDirection = -transformedPosition;
+
+    color = instanceColor;
+
+    /* Transform the position */
+    gl_Position = projectionMatrix*transformedPosition4;
+}
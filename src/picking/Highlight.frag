@@ -0,0 +1,76 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/* WORD_COUNT is defined from the application, it's enough 32-bit words to
+   hold a bit for every object ID */
+
+uniform lowp sampler2D colorTexture;
+uniform highp usampler2D objectIdTexture;
+
+uniform highp uint hoveredId;
+uniform highp uint selection[WORD_COUNT];
+
+out lowp vec4 fragmentColor;
+
+const lowp vec3 hoverOutlineColor = vec3(0.6);
+const lowp vec3 selectionOutlineColor = vec3(1.0);
+
+bool isSelected(highp uint id) {
+    return id < uint(WORD_COUNT*32) && (selection[id >> 5] & (1u << (id & 31u))) != 0u;
+}
+
+bool isHighlighted(highp uint id) {
+    return id != 0u && (id == hoveredId || isSelected(id));
+}
+
+void main() {
+    highp ivec2 position = ivec2(gl_FragCoord.xy);
+    highp ivec2 size = textureSize(objectIdTexture, 0);
+    fragmentColor = texelFetch(colorTexture, position, 0);
+    highp uint id = texelFetch(objectIdTexture, position, 0).r;
+
+    /* Brighten highlighted objects */
+    if(isHighlighted(id)) {
+        fragmentColor.rgb *= isSelected(id) ? 1.5 : 1.2;
+        return;
+    }
+
+    /* Draw outline around them on pixels that neighbor a highlighted one */
+    const highp ivec2 offsets[4] = ivec2[](
+        ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+    for(int i = 0; i != 4; ++i) {
+        highp uint neighborId = texelFetch(objectIdTexture,
+            clamp(position + offsets[i], ivec2(0), size - ivec2(1)), 0).r;
+        if(neighborId != id && isHighlighted(neighborId)) {
+            fragmentColor.rgb = isSelected(neighborId) ?
+                selectionOutlineColor : hoverOutlineColor;
+            return;
+        }
+    }
+}
@@ -29,14 +29,18 @@
 
 uniform lowp vec3 ambientColor;
 uniform lowp vec3 color;
-uniform lowp uint objectId;
+uniform highp uint objectId;
 
 in mediump vec3 transformedNormal;
 in highp vec3 lightDirection;
 in highp vec3 cameraDirection;
 
 layout(location = 0) out lowp vec4 fragmentColor;
-layout(location = 1) out lowp uint fragmentObjectId;
+#ifdef PRIMITIVE_ID_DEPTH
+layout(location = 1) out highp uvec4 fragmentObjectId;
+#else
+layout(location = 1) out highp uint fragmentObjectId;
+#endif
 
 void main() {
     mediump vec3 normalizedTransformedNormal = normalize(transformedNormal);
@@ -58,5 +62,9 @@ void main() {
 
     /* Force alpha to 1 */
     fragmentColor.a = 1.0;
+    #ifdef PRIMITIVE_ID_DEPTH
+    fragmentObjectId = uvec4(objectId, uint(gl_PrimitiveID), floatBitsToUint(gl_FragCoord.z), 0u);
+    #else
     fragmentObjectId = objectId;
+    #endif
 }
@@ -27,36 +27,56 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/EnumSet.h>
+#include <Corrade/Containers/Pointer.h>
 #include <Corrade/Containers/Reference.h>
+#include <Corrade/Utility/Arguments.h>
 #include <Corrade/Utility/Resource.h>
 #include <Magnum/Image.h>
 #include <Magnum/PixelFormat.h>
 #include <Magnum/GL/AbstractShaderProgram.h>
 #include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/BufferImage.h>
 #include <Magnum/GL/Context.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
 #include <Magnum/GL/Framebuffer.h>
 #include <Magnum/GL/Mesh.h>
+#include <Magnum/GL/OpenGL.h>
+#include <Magnum/GL/PixelFormat.h>
 #include <Magnum/GL/Renderbuffer.h>
 #include <Magnum/GL/RenderbufferFormat.h>
 #include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/Sampler.h>
 #include <Magnum/GL/Shader.h>
 #include <Magnum/GL/Texture.h>
 #include <Magnum/GL/TextureFormat.h>
+#include <Magnum/GL/TimeQuery.h>
 #include <Magnum/GL/Version.h>
 #include <Magnum/Math/Color.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Matrix4.h>
 #include <Magnum/MeshTools/CompressIndices.h>
 #include <Magnum/MeshTools/Interleave.h>
 #include <Magnum/Platform/Sdl2Application.h>
 #include <Magnum/Primitives/Cube.h>
 #include <Magnum/Primitives/Plane.h>
 #include <Magnum/Primitives/UVSphere.h>
+#include <Magnum/Shaders/Flat.h>
 #include <Magnum/Trade/MeshData3D.h>
 #include <Magnum/SceneGraph/Scene.h>
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/SceneGraph/Drawable.h>
 
+#include "TriangleBvh.h"
+
 namespace Magnum { namespace Examples {
 
 using namespace Magnum::Math::Literals;
@@ -74,7 +94,22 @@ class PhongIdShader: public GL::AbstractShaderProgram {
             ObjectIdOutput = 1
         };
 
-        explicit PhongIdShader();
+        enum class Flag: UnsignedByte {
+            /**
+             * Output also primitive ID and depth next to the object ID. The
+             * ID output is then four-component, with primitive ID in the
+             * second and depth bits in the third component.
+             */
+            PrimitiveIdDepth = 1 << 0
+        };
+
+        typedef Containers::EnumSet<Flag> Flags;
+
+        explicit PhongIdShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        explicit PhongIdShader(Flags flags = {});
+
+        Flags flags() const { return _flags; }
 
         PhongIdShader& setObjectId(UnsignedInt id) {
             setUniform(_objectIdUniform, id);
@@ -112,6 +147,7 @@ class PhongIdShader: public GL::AbstractShaderProgram {
         }
 
     private:
+        Flags _flags;
         Int _objectIdUniform,
             _lightPositionUniform,
             _ambientColorUniform,
@@ -121,12 +157,16 @@ class PhongIdShader: public GL::AbstractShaderProgram {
             _projectionMatrixUniform;
 };
 
-PhongIdShader::PhongIdShader() {
+CORRADE_ENUMSET_OPERATORS(PhongIdShader::Flags)
+
+PhongIdShader::PhongIdShader(const Flags flags): _flags{flags} {
     Utility::Resource rs("picking-data");
 
     GL::Shader vert{GL::Version::GL330, GL::Shader::Type::Vertex},
         frag{GL::Version::GL330, GL::Shader::Type::Fragment};
     vert.addSource(rs.get("PhongId.vert"));
+    if(flags & Flag::PrimitiveIdDepth)
+        frag.addSource("#define PRIMITIVE_ID_DEPTH\n");
     frag.addSource(rs.get("PhongId.frag"));
     CORRADE_INTERNAL_ASSERT(GL::Shader::compile({vert, frag}));
     attachShaders({vert, frag});
@@ -141,18 +181,144 @@ PhongIdShader::PhongIdShader() {
     _normalMatrixUniform = uniformLocation("normalMatrix");
 }
 
+class SelectIdsShader: public GL::AbstractShaderProgram {
+    public:
+        enum: UnsignedInt {
+            SelectionBufferBinding = 0,
+            LassoBufferBinding = 1
+        };
+
+        explicit SelectIdsShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        /* Word count is the size of the selection buffer in 32-bit words,
+           i.e. one bit for every object ID */
+        explicit SelectIdsShader(UnsignedInt wordCount);
+
+        SelectIdsShader& setRegion(const Range2Di& region) {
+            setUniform(_regionOffsetUniform, region.min());
+            setUniform(_regionSizeUniform, region.size());
+            return *this;
+        }
+
+        /* If zero, the whole region is selected */
+        SelectIdsShader& setLassoPointCount(Int count) {
+            setUniform(_lassoPointCountUniform, count);
+            return *this;
+        }
+
+        SelectIdsShader& bindObjectIdTexture(GL::Texture2D& texture) {
+            texture.bind(ObjectIdTextureLayer);
+            return *this;
+        }
+
+        SelectIdsShader& bindSelectionBuffer(GL::Buffer& buffer) {
+            buffer.bind(GL::Buffer::Target::ShaderStorage, SelectionBufferBinding);
+            return *this;
+        }
+
+        SelectIdsShader& bindLassoBuffer(GL::Buffer& buffer) {
+            buffer.bind(GL::Buffer::Target::ShaderStorage, LassoBufferBinding);
+            return *this;
+        }
+
+    private:
+        enum: Int { ObjectIdTextureLayer = 0 };
+
+        Int _regionOffsetUniform,
+            _regionSizeUniform,
+            _lassoPointCountUniform;
+};
+
+SelectIdsShader::SelectIdsShader(const UnsignedInt wordCount) {
+    Utility::Resource rs("picking-data");
+
+    GL::Shader comp{GL::Version::GL430, GL::Shader::Type::Compute};
+    comp.addSource("#define WORD_COUNT " + std::to_string(wordCount) + "\n")
+        .addSource(rs.get("SelectIds.comp"));
+    CORRADE_INTERNAL_ASSERT(GL::Shader::compile({comp}));
+    attachShader(comp);
+    CORRADE_INTERNAL_ASSERT(link());
+
+    _regionOffsetUniform = uniformLocation("regionOffset");
+    _regionSizeUniform = uniformLocation("regionSize");
+    _lassoPointCountUniform = uniformLocation("lassoPointCount");
+}
+
+class HighlightShader: public GL::AbstractShaderProgram {
+    public:
+        explicit HighlightShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        /* Word count is the size of the selection in 32-bit words, i.e. one
+           bit for every object ID */
+        explicit HighlightShader(UnsignedInt wordCount);
+
+        HighlightShader& setHoveredId(UnsignedInt id) {
+            setUniform(_hoveredIdUniform, id);
+            return *this;
+        }
+
+        HighlightShader& setSelection(Containers::ArrayView<const UnsignedInt> selection) {
+            setUniform(_selectionUniform, selection);
+            return *this;
+        }
+
+        HighlightShader& bindColorTexture(GL::Texture2D& texture) {
+            texture.bind(ColorTextureLayer);
+            return *this;
+        }
+
+        HighlightShader& bindObjectIdTexture(GL::Texture2D& texture) {
+            texture.bind(ObjectIdTextureLayer);
+            return *this;
+        }
+
+    private:
+        enum: Int {
+            ColorTextureLayer = 0,
+            ObjectIdTextureLayer = 1
+        };
+
+        Int _hoveredIdUniform,
+            _selectionUniform;
+};
+
+HighlightShader::HighlightShader(const UnsignedInt wordCount) {
+    Utility::Resource rs("picking-data");
+
+    GL::Shader vert{GL::Version::GL330, GL::Shader::Type::Vertex},
+        frag{GL::Version::GL330, GL::Shader::Type::Fragment};
+    vert.addSource(rs.get("Highlight.vert"));
+    frag.addSource("#define WORD_COUNT " + std::to_string(wordCount) + "\n")
+        .addSource(rs.get("Highlight.frag"));
+    CORRADE_INTERNAL_ASSERT(GL::Shader::compile({vert, frag}));
+    attachShaders({vert, frag});
+    CORRADE_INTERNAL_ASSERT(link());
+
+    _hoveredIdUniform = uniformLocation("hoveredId");
+    _selectionUniform = uniformLocation("selection");
+    setUniform(uniformLocation("colorTexture"), ColorTextureLayer);
+    setUniform(uniformLocation("objectIdTexture"), ObjectIdTextureLayer);
+}
+
 class PickableObject: public Object3D, SceneGraph::Drawable3D {
     public:
-        explicit PickableObject(UnsignedByte id, PhongIdShader& shader, const Color3& color, GL::Mesh& mesh, Object3D& parent, SceneGraph::DrawableGroup3D& drawables): Object3D{&parent}, SceneGraph::Drawable3D{*this, &drawables}, _id{id}, _selected{false}, _shader(shader), _color{color}, _mesh(mesh) {}
+        explicit PickableObject(UnsignedInt id, PhongIdShader& shader, const Color3& color, GL::Mesh& mesh, const TriangleBvh& bvh, Object3D& parent, SceneGraph::DrawableGroup3D& drawables): Object3D{&parent}, SceneGraph::Drawable3D{*this, &drawables}, _id{id}, _selected{false}, _hovered{false}, _shader(shader), _color{color}, _mesh(mesh), _bvh(bvh) {}
+
+        UnsignedInt id() const { return _id; }
+
+        /* For ray casting on the CPU */
+        const TriangleBvh& bvh() const { return _bvh; }
 
         void setSelected(bool selected) { _selected = selected; }
+        void setHovered(bool hovered) { _hovered = hovered; }
 
     private:
         virtual void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& camera) {
             _shader.setTransformationMatrix(transformationMatrix)
                 .setNormalMatrix(transformationMatrix.rotationScaling())
                 .setProjectionMatrix(camera.projectionMatrix())
-                .setAmbientColor(_selected ? _color*0.3f : Color3{})
+                .setAmbientColor(_selected ? _color*0.3f :
+                                 _hovered ? _color*0.15f : Color3{})
                 .setColor(_color*(_selected ? 2.0f : 1.0f))
                 /* relative to the camera */
                 .setLightPosition({13.0f, 2.0f, 5.0f})
@@ -160,39 +326,114 @@ class PickableObject: public Object3D, SceneGraph::Drawable3D {
             _mesh.draw(_shader);
         }
 
-        UnsignedByte _id;
-        bool _selected;
+        UnsignedInt _id;
+        bool _selected, _hovered;
         PhongIdShader& _shader;
         Color3 _color;
         GL::Mesh& _mesh;
+        const TriangleBvh& _bvh;
 };
 
 class PickingExample: public Platform::Application {
     public:
         explicit PickingExample(const Arguments& arguments);
 
+        ~PickingExample();
+
     private:
+        struct PickRequest {
+            Vector2i position;
+            bool select;
+        };
+
         void drawEvent() override;
         void mousePressEvent(MouseEvent& event) override;
         void mouseMoveEvent(MouseMoveEvent& event) override;
         void mouseReleaseEvent(MouseEvent& event) override;
 
+        void pick(const PickRequest& request);
+        void readPick(const PickRequest& request);
+        bool resolvePick();
+        void applyPick(const PickRequest& request, PickableObject* picked);
+        PickableObject* raycast(const Vector2i& position, const Vector2i& size, Vector3& hitPosition, UnsignedInt& hitTriangle);
+        void drawIds(GL::Framebuffer& framebuffer, const Range2Di& region);
+        void selectRegion();
+        bool resolveSelection();
+        void updateHighlight();
+        void drawSelectionOutline();
+        void benchmark();
+
         Scene3D _scene;
         Object3D* _cameraObject;
         SceneGraph::Camera3D* _camera;
         SceneGraph::DrawableGroup3D _drawables;
 
-        PhongIdShader _shader;
+        PhongIdShader _shader{NoCreate};
         GL::Buffer _cubeVertices, _cubeIndices,
             _sphereVertices, _sphereIndices,
             _planeVertices;
         GL::Mesh _cube, _plane, _sphere;
+        Containers::Pointer<TriangleBvh> _cubeBvh, _planeBvh, _sphereBvh;
 
         enum { ObjectCount = 6 };
         PickableObject* _objects[ObjectCount];
 
+        /* Hovered object ID and a set of selected IDs, one bit per ID */
+        enum { SelectionWordCount = (ObjectCount + 1 + 31)/32 };
+        UnsignedInt _hoveredId{};
+        UnsignedInt _selectedIds[SelectionWordCount]{};
+
         GL::Framebuffer _framebuffer;
-        GL::Renderbuffer _color, _objectId, _depth;
+        GL::Renderbuffer _depth;
+        GL::Texture2D _color, _objectId;
+
+        /* Highlight of hovered and selected objects. Unless IDs are rendered
+           on demand, the highlight is applied in a full-screen pass that
+           composites the color and ID attachments, so when just the
+           highlight changes the scene doesn't need to be rendered again. */
+        HighlightShader _highlightShader{NoCreate};
+        GL::Mesh _fullscreenTriangle;
+        bool _sceneDirty{true};
+
+        /* On-demand picking. The scene is drawn directly to the window and
+           the ID attachment is filled only when picking, in a scissored
+           region under the cursor. */
+        bool _onDemand;
+        GL::Framebuffer _idFramebuffer{NoCreate};
+
+        /* Picking by casting a ray against BVHs of the meshes on the CPU,
+           without touching the GPU at all */
+        bool _raycast;
+
+        /* Asynchronous picking. The ID under the cursor is copied into a
+           pixel buffer and resolved only once a fence signals that the copy
+           is done, so the CPU never waits for the GPU. At most one read is in
+           flight, a request coming meanwhile waits for it. */
+        GL::BufferImage2D _pickImage{GL::PixelFormat::RedInteger, GL::PixelType::UnsignedInt};
+        GLsync _pickFence{};
+        /* Inverse view-projection matrix of the frame the pick was read from,
+           for calculating world position from the depth */
+        Matrix4 _pickInverseViewProjection;
+        PickRequest _pickInFlight, _pickPending;
+        bool _hasPickPending{};
+
+        /* Rectangle and lasso selection. A compute shader reduces IDs in the
+           region to a set with one bit per ID, only that is read back. The
+           read is fenced the same way as the single-pixel pick. */
+        enum class Selection: UnsignedByte {
+            None,
+            Rectangle,
+            Lasso
+        };
+        Selection _selecting{Selection::None};
+        std::vector<Vector2i> _selectionPoints;
+        SelectIdsShader _selectIdsShader{NoCreate};
+        GL::Buffer _selectionBuffer, _lassoBuffer;
+        GLsync _selectionFence{};
+
+        Shaders::Flat2D _outlineShader;
+        GL::Buffer _outlineVertices;
+        GL::Mesh _outline;
 
         Vector2i _previousMousePosition, _mousePressPosition;
 };
@@ -200,20 +441,70 @@ class PickingExample: public Platform::Application {
 PickingExample::PickingExample(const Arguments& arguments): Platform::Application{arguments, Configuration{}.setTitle("Magnum object picking example")}, _framebuffer{GL::defaultFramebuffer.viewport()} {
     MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL330);
 
+    Utility::Arguments args;
+    args.addBooleanOption("primitive-id").setHelp("primitive-id", "pick also the triangle and world position under the cursor")
+        .addBooleanOption("on-demand").setHelp("on-demand", "render object IDs only when picking instead of every frame")
+        .addBooleanOption("raycast").setHelp("raycast", "pick by casting rays on the CPU instead of reading the framebuffer")
+        .addBooleanOption("benchmark").setHelp("benchmark", "compare always-on and on-demand ID rendering at 4K and CPU ray casting with framebuffer reads")
+        .addSkippedPrefix("magnum").setHelp("engine-specific options")
+        .parse(arguments.argc, arguments.argv);
+
+    /* With primitive ID and depth the ID attachment has four components,
+       which still fits a single readback */
+    const bool primitiveIdDepth = args.isSet("primitive-id");
+    _shader = PhongIdShader{primitiveIdDepth ?
+        PhongIdShader::Flag::PrimitiveIdDepth : PhongIdShader::Flags{}};
+    if(primitiveIdDepth)
+        _pickImage = GL::BufferImage2D{GL::PixelFormat::RGBAInteger, GL::PixelType::UnsignedInt};
+
     /* Global renderer configuration */
     GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+    GL::Renderer::setClearColor(Color3{0.125f});
 
-    /* Configure framebuffer (using R8UI for object ID which means 255 objects max) */
-    _color.setStorage(GL::RenderbufferFormat::RGBA8, GL::defaultFramebuffer.viewport().size());
-    _objectId.setStorage(GL::RenderbufferFormat::R8UI, GL::defaultFramebuffer.viewport().size());
+    /* Configure framebuffer (using R32UI for object ID, which is enough for
+       billions of objects). The IDs are in a texture so the region selection
+       can fetch them in a compute shader. */
+    _color.setMinificationFilter(GL::SamplerFilter::Nearest)
+        .setMagnificationFilter(GL::SamplerFilter::Nearest)
+        .setStorage(1, GL::TextureFormat::RGBA8, GL::defaultFramebuffer.viewport().size());
+    _objectId.setMinificationFilter(GL::SamplerFilter::Nearest)
+        .setMagnificationFilter(GL::SamplerFilter::Nearest)
+        .setStorage(1, primitiveIdDepth ? GL::TextureFormat::RGBA32UI : GL::TextureFormat::R32UI, GL::defaultFramebuffer.viewport().size());
     _depth.setStorage(GL::RenderbufferFormat::DepthComponent24, GL::defaultFramebuffer.viewport().size());
-    _framebuffer.attachRenderbuffer(GL::Framebuffer::ColorAttachment{0}, _color)
-               .attachRenderbuffer(GL::Framebuffer::ColorAttachment{1}, _objectId)
+    _framebuffer.attachTexture(GL::Framebuffer::ColorAttachment{0}, _color, 0)
+               .attachTexture(GL::Framebuffer::ColorAttachment{1}, _objectId, 0)
                .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, _depth)
                .mapForDraw({{PhongIdShader::ColorOutput, GL::Framebuffer::ColorAttachment{0}},
                             {PhongIdShader::ObjectIdOutput, GL::Framebuffer::ColorAttachment{1}}});
     CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(GL::FramebufferTarget::Draw) == GL::Framebuffer::Status::Complete);
 
+    /* For on-demand picking the IDs go to a separate framebuffer that shares
+       the ID and depth attachments, color is drawn to the window directly */
+    _onDemand = args.isSet("on-demand");
+    _raycast = args.isSet("raycast");
+    if(_onDemand) {
+        _idFramebuffer = GL::Framebuffer{GL::defaultFramebuffer.viewport()};
+        _idFramebuffer.attachTexture(GL::Framebuffer::ColorAttachment{0}, _objectId, 0)
+            .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, _depth)
+            .mapForDraw({{PhongIdShader::ColorOutput, GL::Framebuffer::DrawAttachment::None},
+                         {PhongIdShader::ObjectIdOutput, GL::Framebuffer::ColorAttachment{0}}});
+        CORRADE_INTERNAL_ASSERT(_idFramebuffer.checkStatus(GL::FramebufferTarget::Draw) == GL::Framebuffer::Status::Complete);
+
+    /* Otherwise the highlight is composited from the attachments */
+    } else {
+        _highlightShader = HighlightShader{SelectionWordCount};
+        _fullscreenTriangle.setCount(3);
+    }
+
+    /* Rectangle and lasso selection needs compute shaders */
+    if(GL::Context::current().isVersionSupported(GL::Version::GL430))
+        _selectIdsShader = SelectIdsShader{SelectionWordCount};
+    else Warning{} << "OpenGL 4.3 is not supported, rectangle and lasso selection is disabled";
+
+    _outline.setPrimitive(GL::MeshPrimitive::LineLoop)
+        .addVertexBuffer(_outlineVertices, 0, Shaders::Flat2D::Position{});
+    _outlineShader.setColor(0xffffff_rgbf);
+
     /* Set up meshes */
     {
         Trade::MeshData3D data = Primitives::cubeSolid();
@@ -223,6 +514,7 @@ PickingExample::PickingExample(const Arguments& arguments): Platform::Applicatio
             .setPrimitive(data.primitive())
             .addVertexBuffer(_cubeVertices, 0, PhongIdShader::Position{}, PhongIdShader::Normal{})
             .setIndexBuffer(_cubeIndices, 0, MeshIndexType::UnsignedShort);
+        _cubeBvh.reset(new TriangleBvh{data});
     } {
         Trade::MeshData3D data = Primitives::uvSphereSolid(16, 32);
         _sphereVertices.setData(MeshTools::interleave(data.positions(0), data.normals(0)), GL::BufferUsage::StaticDraw);
@@ -231,30 +523,32 @@ PickingExample::PickingExample(const Arguments& arguments): Platform::Applicatio
             .setPrimitive(data.primitive())
             .addVertexBuffer(_sphereVertices, 0, PhongIdShader::Position{}, PhongIdShader::Normal{})
             .setIndexBuffer(_sphereIndices, 0, MeshIndexType::UnsignedShort);
+        _sphereBvh.reset(new TriangleBvh{data});
     } {
         Trade::MeshData3D data = Primitives::planeSolid();
         _planeVertices.setData(MeshTools::interleave(data.positions(0), data.normals(0)), GL::BufferUsage::StaticDraw);
         _plane.setCount(data.positions(0).size())
             .setPrimitive(data.primitive())
             .addVertexBuffer(_planeVertices, 0, PhongIdShader::Position{}, PhongIdShader::Normal{});
+        _planeBvh.reset(new TriangleBvh{data});
     }
 
     /* Set up objects */
-    (*(_objects[0] = new PickableObject{1, _shader, 0x3bd267_rgbf, _cube, _scene, _drawables}))
+    (*(_objects[0] = new PickableObject{1, _shader, 0x3bd267_rgbf, _cube, *_cubeBvh, _scene, _drawables}))
         .rotate(34.0_degf, Vector3(1.0f).normalized())
         .translate({1.0f, 0.3f, -1.2f});
-    (*(_objects[1] = new PickableObject{2, _shader, 0x2f83cc_rgbf, _sphere, _scene, _drawables}))
+    (*(_objects[1] = new PickableObject{2, _shader, 0x2f83cc_rgbf, _sphere, *_sphereBvh, _scene, _drawables}))
         .translate({-1.2f, -0.3f, -0.2f});
-    (*(_objects[2] = new PickableObject{3, _shader, 0xdcdcdc_rgbf, _plane, _scene, _drawables}))
+    (*(_objects[2] = new PickableObject{3, _shader, 0xdcdcdc_rgbf, _plane, *_planeBvh, _scene, _drawables}))
         .rotate(278.0_degf, Vector3(1.0f).normalized())
         .scale(Vector3(0.45f))
         .translate({-1.0f, 1.2f, 1.5f});
-    (*(_objects[3] = new PickableObject{4, _shader, 0xc7cf2f_rgbf, _sphere, _scene, _drawables}))
+    (*(_objects[3] = new PickableObject{4, _shader, 0xc7cf2f_rgbf, _sphere, *_sphereBvh, _scene, _drawables}))
         .translate({-0.2f, -1.7f, -2.7f});
-    (*(_objects[4] = new PickableObject{5, _shader, 0xcd3431_rgbf, _sphere, _scene, _drawables}))
+    (*(_objects[4] = new PickableObject{5, _shader, 0xcd3431_rgbf, _sphere, *_sphereBvh, _scene, _drawables}))
         .translate({0.7f, 0.6f, 2.2f})
         .scale(Vector3(0.75f));
-    (*(_objects[5] = new PickableObject{6, _shader, 0xa5c9ea_rgbf, _cube, _scene, _drawables}))
+    (*(_objects[5] = new PickableObject{6, _shader, 0xa5c9ea_rgbf, _cube, *_cubeBvh, _scene, _drawables}))
         .rotate(-92.0_degf, Vector3(1.0f).normalized())
         .scale(Vector3(0.25f))
         .translate({-0.5f, -0.3f, 1.8f});
@@ -266,39 +560,106 @@ PickingExample::PickingExample(const Arguments& arguments): Platform::Applicatio
     _camera->setAspectRatioPolicy(SceneGraph::AspectRatioPolicy::Extend)
         .setProjectionMatrix(Matrix4::perspectiveProjection(35.0_degf, 4.0f/3.0f, 0.001f, 100.0f))
         .setViewport(GL::defaultFramebuffer.viewport().size());
+
+    if(args.isSet("benchmark")) benchmark();
+}
+
+PickingExample::~PickingExample() {
+    if(_pickFence) glDeleteSync(_pickFence);
+    if(_selectionFence) glDeleteSync(_selectionFence);
 }
 
 void PickingExample::drawEvent() {
-    /* Draw to custom framebuffer */
-    _framebuffer
-        .clearColor(0, Color3{0.125f})
-        .clearColor(1, Vector4ui{})
-        .clearDepth(1.0f)
-        .bind();
-    _camera->draw(_drawables);
+    /* Apply a pick or a selection issued in some previous frame, if the GPU
+       is done with it */
+    resolvePick();
+    resolveSelection();
 
-    /* Bind the main buffer back */
-    GL::defaultFramebuffer.clear(GL::FramebufferClear::Color|GL::FramebufferClear::Depth)
-        .bind();
+    /* Draw just color to the window, the ID output goes nowhere */
+    if(_onDemand) {
+        GL::defaultFramebuffer.clear(GL::FramebufferClear::Color|GL::FramebufferClear::Depth)
+            .bind();
+        _camera->draw(_drawables);
 
-    /* Blit color to window framebuffer */
-    _framebuffer.mapForRead(GL::Framebuffer::ColorAttachment{0});
-    GL::AbstractFramebuffer::blit(_framebuffer, GL::defaultFramebuffer,
-        {{}, _framebuffer.viewport().size()}, GL::FramebufferBlit::Color);
+    /* Draw to custom framebuffer, but only if the scene changed. If just the
+       highlight changed, the attachments still have the previous frame. */
+    } else {
+        if(_sceneDirty) {
+            _framebuffer
+                .clearColor(0, Color3{0.125f})
+                .clearColor(1, Vector4ui{})
+                .clearDepth(1.0f)
+                .bind();
+            _camera->draw(_drawables);
+            _sceneDirty = false;
+        }
+
+        /* Composite color with the highlight to the window framebuffer. The
+           triangle covers it whole, so there's no need to clear. */
+        GL::defaultFramebuffer.bind();
+        GL::Renderer::disable(GL::Renderer::Feature::DepthTest);
+        _highlightShader
+            .setHoveredId(_hoveredId)
+            .setSelection(_selectedIds)
+            .bindColorTexture(_color)
+            .bindObjectIdTexture(_objectId);
+        _fullscreenTriangle.draw(_highlightShader);
+        GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+    }
+
+    drawSelectionOutline();
+
+    /* Issue a pick that came while another was in flight. The ID attachment
+       has the contents of this frame. */
+    if(_hasPickPending && !_pickFence) {
+        _hasPickPending = false;
+        readPick(_pickPending);
+    }
 
     swapBuffers();
+
+    /* Keep polling until the pick and selection is resolved */
+    if(_pickFence || _selectionFence) redraw();
 }
 
 void PickingExample::mousePressEvent(MouseEvent& event) {
     if(event.button() != MouseEvent::Button::Left) return;
 
     _previousMousePosition = _mousePressPosition = event.position();
+
+    /* Shift + drag selects objects in a rectangle, Ctrl + drag in a lasso */
+    if(_selectIdsShader.id() && event.modifiers() & (MouseEvent::Modifier::Shift|MouseEvent::Modifier::Ctrl)) {
+        _selecting = event.modifiers() & MouseEvent::Modifier::Shift ?
+            Selection::Rectangle : Selection::Lasso;
+        _selectionPoints = {event.position()};
+    }
+
     event.setAccepted();
 }
 
 void PickingExample::mouseMoveEvent(MouseMoveEvent& event) {
+    /* Hover picking. The ID attachment still contains the last drawn frame
+       or gets rendered on demand, so there's no need to redraw in order to
+       pick from it. */
+    if(!event.buttons()) {
+        pick({event.position(), false});
+        event.setAccepted();
+        return;
+    }
+
     if(!(event.buttons() & MouseMoveEvent::Button::Left)) return;
 
+    /* Rectangle needs just the two corners, lasso all points */
+    if(_selecting != Selection::None) {
+        if(_selecting == Selection::Rectangle)
+            _selectionPoints.resize(1);
+        if(_selectionPoints.back() != event.position())
+            _selectionPoints.push_back(event.position());
+        event.setAccepted();
+        redraw();
+        return;
+    }
+
     const Vector2 delta = 3.0f*
         Vector2{event.position() - _previousMousePosition}/
         Vector2{GL::defaultFramebuffer.viewport().size()};
@@ -308,29 +669,388 @@ void PickingExample::mouseMoveEvent(MouseMoveEvent& event) {
         .rotateY(Rad{-delta.x()});
 
     _previousMousePosition = event.position();
+    _sceneDirty = true;
     event.setAccepted();
     redraw();
 }
 
 void PickingExample::mouseReleaseEvent(MouseEvent& event) {
-    if(event.button() != MouseEvent::Button::Left || _mousePressPosition != event.position()) return;
+    if(event.button() != MouseEvent::Button::Left) return;
 
-    /* Read object ID at given click position (framebuffer has Y up while windowing system Y down) */
-    _framebuffer.mapForRead(GL::Framebuffer::ColorAttachment{1});
-    Image2D data = _framebuffer.read(
-        Range2Di::fromSize({event.position().x(), _framebuffer.viewport().sizeY() - event.position().y() - 1}, {1, 1}),
-        {PixelFormat::R8UI});
+    if(_selecting != Selection::None) {
+        selectRegion();
+        _selecting = Selection::None;
+        _selectionPoints.clear();
+        event.setAccepted();
+        redraw();
+        return;
+    }
 
-    /* Highlight object under mouse and deselect all other */
-    for(auto* o: _objects) o->setSelected(false);
-    UnsignedByte id = data.data<UnsignedByte>()[0];
-    if(id > 0 && id < ObjectCount + 1)
-        _objects[id - 1]->setSelected(true);
+    if(_mousePressPosition != event.position()) return;
 
+    pick({event.position(), true});
     event.setAccepted();
+}
+
+void PickingExample::pick(const PickRequest& request) {
+    /* Outside of the window, nothing to pick */
+    if(!(request.position >= Vector2i{}).all() ||
+       !(request.position < _framebuffer.viewport().size()).all())
+        return;
+
+    /* Cast a ray on the CPU, the result is known immediately */
+    if(_raycast) {
+        Vector3 hitPosition;
+        UnsignedInt hitTriangle;
+        PickableObject* const picked = raycast(request.position,
+            _framebuffer.viewport().size(), hitPosition, hitTriangle);
+        if(picked && request.select)
+            Debug{} << "Picked object" << picked->id() << "triangle" << hitTriangle << "at" << hitPosition;
+        applyPick(request, picked);
+        redraw();
+        return;
+    }
+
+    /* Another read is in flight, remember this one for later. Don't let a
+       hover overwrite a pending selection. */
+    if(_pickFence) {
+        if(!_hasPickPending || !_pickPending.select || request.select)
+            _pickPending = request;
+        _hasPickPending = true;
+        return;
+    }
+
+    readPick(request);
     redraw();
 }
 
+void PickingExample::readPick(const PickRequest& request) {
+    /* Framebuffer has Y up while windowing system Y down */
+    const Range2Di region = Range2Di::fromSize({request.position.x(),
+        _framebuffer.viewport().sizeY() - request.position.y() - 1}, {1, 1});
+
+    /* Render the IDs just for the pixel that's going to be read */
+    GL::Framebuffer* framebuffer;
+    if(_onDemand) {
+        drawIds(_idFramebuffer, region);
+        _idFramebuffer.mapForRead(GL::Framebuffer::ColorAttachment{0});
+        framebuffer = &_idFramebuffer;
+    } else {
+        _framebuffer.mapForRead(GL::Framebuffer::ColorAttachment{1});
+        framebuffer = &_framebuffer;
+    }
+
+    /* Read object ID at given position into the pixel buffer. This only
+       queues the copy. */
+    framebuffer->read(region, _pickImage, GL::BufferUsage::StreamRead);
+    _pickFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _pickInFlight = request;
+    _pickInverseViewProjection = (_camera->projectionMatrix()*_camera->cameraMatrix()).inverted();
+}
+
+bool PickingExample::resolvePick() {
+    if(!_pickFence) return false;
+
+    /* Just query the status, don't wait */
+    const GLenum status = glClientWaitSync(_pickFence, 0, 0);
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+    glDeleteSync(_pickFence);
+    _pickFence = nullptr;
+
+    /* The copy is finished, so mapping the buffer doesn't stall. With
+       primitive ID and depth there are four components, otherwise one. */
+    const bool primitiveIdDepth = !!(_shader.flags() & PhongIdShader::Flag::PrimitiveIdDepth);
+    GL::Buffer& buffer = _pickImage.buffer();
+    Vector4ui data;
+    const Containers::ArrayView<const UnsignedInt> mapped = Containers::arrayCast<const UnsignedInt>(
+        buffer.map(0, (primitiveIdDepth ? 4 : 1)*sizeof(UnsignedInt), GL::Buffer::MapFlag::Read));
+    for(std::size_t i = 0; i != mapped.size(); ++i) data[i] = mapped[i];
+    buffer.unmap();
+
+    const UnsignedInt id = data[0];
+
+    PickableObject* const picked = id > 0 && id < ObjectCount + 1 ?
+        _objects[id - 1] : nullptr;
+
+    /* Unproject the pixel center with the depth to get the world position */
+    if(_pickInFlight.select && picked && primitiveIdDepth) {
+        Float depth;
+        std::memcpy(&depth, &data[2], sizeof(Float));
+        const Vector2i size = _framebuffer.viewport().size();
+        const Vector2 pixel{Float(_pickInFlight.position.x()) + 0.5f,
+                            Float(size.y() - _pickInFlight.position.y() - 1) + 0.5f};
+        const Vector3 ndc{pixel/Vector2{size}*2.0f - Vector2{1.0f}, depth*2.0f - 1.0f};
+        Debug{} << "Picked object" << id << "triangle" << data[1]
+            << "at" << _pickInverseViewProjection.transformPoint(ndc);
+    }
+
+    applyPick(_pickInFlight, picked);
+    return true;
+}
+
+void PickingExample::applyPick(const PickRequest& request, PickableObject* const picked) {
+    /* Highlight object under mouse and deselect all other */
+    const UnsignedInt id = picked ? picked->id() : 0;
+    if(request.select) {
+        std::fill_n(_selectedIds, SelectionWordCount, 0);
+        if(id) _selectedIds[id >> 5] |= 1u << (id & 31);
+    } else _hoveredId = id;
+
+    updateHighlight();
+}
+
+void PickingExample::updateHighlight() {
+    /* The composite pass takes the highlight directly from _hoveredId and
+       _selectedIds. When IDs are rendered on demand there's nothing to
+       composite from and the objects have to be rendered highlighted
+       instead. */
+    if(!_onDemand) return;
+
+    for(PickableObject* o: _objects) {
+        o->setSelected(_selectedIds[o->id() >> 5] & (1u << (o->id() & 31)));
+        o->setHovered(o->id() == _hoveredId);
+    }
+}
+
+PickableObject* PickingExample::raycast(const Vector2i& position, const Vector2i& size, Vector3& hitPosition, UnsignedInt& hitTriangle) {
+    /* Ray through the pixel center from the near to the far plane (window
+       has Y down while NDC has Y up) */
+    const Vector2 ndc{(Float(position.x()) + 0.5f)/size.x()*2.0f - 1.0f,
+                      1.0f - (Float(position.y()) + 0.5f)/size.y()*2.0f};
+    const Matrix4 inverseViewProjection = (_camera->projectionMatrix()*_camera->cameraMatrix()).inverted();
+    const Vector3 origin = inverseViewProjection.transformPoint({ndc, -1.0f});
+    const Vector3 direction = inverseViewProjection.transformPoint({ndc, 1.0f}) - origin;
+
+    /* The direction isn't normalized, so the ray parameter is the same in
+       world space and in object space of each object and hits of different
+       objects can be compared directly */
+    PickableObject* picked{};
+    TriangleBvh::Hit hit{1.0f, 0};
+    for(PickableObject* o: _objects) {
+        const Matrix4 inverseTransformation = o->absoluteTransformationMatrix().inverted();
+        if(o->bvh().intersect(inverseTransformation.transformPoint(origin),
+            inverseTransformation.transformVector(direction), hit.distance, hit))
+            picked = o;
+    }
+
+    if(picked) {
+        hitPosition = origin + direction*hit.distance;
+        hitTriangle = hit.triangle;
+    }
+    return picked;
+}
+
+void PickingExample::drawIds(GL::Framebuffer& framebuffer, const Range2Di& region) {
+    /* Both the clear and the draw touch only the scissored region, so the
+       fill cost is negligible compared to rendering IDs for the whole
+       frame */
+    GL::Renderer::enable(GL::Renderer::Feature::ScissorTest);
+    GL::Renderer::setScissor(region);
+    framebuffer
+        .clearColor(PhongIdShader::ObjectIdOutput, Vector4ui{})
+        .clearDepth(1.0f)
+        .bind();
+    _camera->draw(_drawables);
+    GL::Renderer::disable(GL::Renderer::Feature::ScissorTest);
+
+    GL::defaultFramebuffer.bind();
+}
+
+void PickingExample::selectRegion() {
+    const Vector2i size = _framebuffer.viewport().size();
+    if(_selectionPoints.size() < (_selecting == Selection::Lasso ? 3 : 2))
+        return;
+
+    /* Pixel centers in framebuffer coordinates, which have Y up */
+    std::vector<Vector2> points;
+    points.reserve(_selectionPoints.size());
+    for(const Vector2i& p: _selectionPoints)
+        points.emplace_back(Float(p.x()) + 0.5f, Float(size.y() - p.y()) - 0.5f);
+
+    /* Bounding rectangle of all points, clipped to the framebuffer */
+    Vector2 min = points.front(), max = points.front();
+    for(const Vector2& p: points) {
+        min = Math::min(min, p);
+        max = Math::max(max, p);
+    }
+    const Range2Di region{Math::max(Vector2i{min}, Vector2i{}),
+                          Math::min(Vector2i{max} + Vector2i{1}, size)};
+    if(!(region.size() > Vector2i{}).all()) return;
+
+    /* Render the IDs just for the selected region */
+    if(_onDemand) drawIds(_idFramebuffer, region);
+
+    /* A selection that's still in flight is superseded by this one */
+    if(_selectionFence) glDeleteSync(_selectionFence);
+
+    const UnsignedInt zeros[SelectionWordCount]{};
+    _selectionBuffer.setData(zeros, GL::BufferUsage::DynamicRead);
+    if(_selecting == Selection::Lasso) {
+        _lassoBuffer.setData(Containers::arrayView(points.data(), points.size()), GL::BufferUsage::StreamDraw);
+        _selectIdsShader.setLassoPointCount(Int(points.size()))
+            .bindLassoBuffer(_lassoBuffer);
+    } else _selectIdsShader.setLassoPointCount(0);
+
+    /* One 16x16 workgroup per block of the region, the selection buffer is
+       then the only thing that gets read back */
+    _selectIdsShader.setRegion(region)
+        .bindObjectIdTexture(_objectId)
+        .bindSelectionBuffer(_selectionBuffer)
+        .dispatchCompute({(Vector2ui{region.size()} + Vector2ui{15})/16, 1});
+    GL::Renderer::setMemoryBarrier(GL::Renderer::MemoryBarrier::BufferUpdate);
+    _selectionFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool PickingExample::resolveSelection() {
+    if(!_selectionFence) return false;
+
+    /* Just query the status, don't wait */
+    const GLenum status = glClientWaitSync(_selectionFence, 0, 0);
+    if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+    glDeleteSync(_selectionFence);
+    _selectionFence = nullptr;
+
+    const Containers::ArrayView<const UnsignedInt> selection = Containers::arrayCast<const UnsignedInt>(
+        _selectionBuffer.map(0, SelectionWordCount*sizeof(UnsignedInt), GL::Buffer::MapFlag::Read));
+    std::copy(selection.begin(), selection.end(), _selectedIds);
+    _selectionBuffer.unmap();
+
+    std::size_t count = 0;
+    for(PickableObject* o: _objects)
+        if(_selectedIds[o->id() >> 5] & (1u << (o->id() & 31))) ++count;
+
+    Debug{} << "Selected" << count << "objects";
+    updateHighlight();
+    return true;
+}
+
+void PickingExample::drawSelectionOutline() {
+    if(_selectionPoints.size() < 2) return;
+
+    /* Window coordinates to NDC */
+    const Vector2 size{_framebuffer.viewport().size()};
+    const auto ndc = [&size](const Vector2i& p) {
+        return Vector2{Float(p.x())/size.x()*2.0f - 1.0f,
+                       1.0f - Float(p.y())/size.y()*2.0f};
+    };
+
+    std::vector<Vector2> positions;
+    if(_selecting == Selection::Rectangle) {
+        const Vector2i a = _selectionPoints.front(), b = _selectionPoints.back();
+        positions = {ndc(a), ndc({b.x(), a.y()}), ndc(b), ndc({a.x(), b.y()})};
+    } else for(const Vector2i& p: _selectionPoints)
+        positions.push_back(ndc(p));
+
+    _outlineVertices.setData(Containers::arrayView(positions.data(), positions.size()), GL::BufferUsage::StreamDraw);
+    _outline.setCount(positions.size());
+
+    GL::Renderer::disable(GL::Renderer::Feature::DepthTest);
+    _outline.draw(_outlineShader);
+    GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+}
+
+void PickingExample::benchmark() {
+    const Vector2i size{3840, 2160};
+    constexpr Int Iterations = 100;
+
+    GL::Renderbuffer color, objectId, depth;
+    color.setStorage(GL::RenderbufferFormat::RGBA8, size);
+    objectId.setStorage(_shader.flags() & PhongIdShader::Flag::PrimitiveIdDepth ?
+        GL::RenderbufferFormat::RGBA32UI : GL::RenderbufferFormat::R32UI, size);
+    depth.setStorage(GL::RenderbufferFormat::DepthComponent24, size);
+
+    /* Always-on: color and IDs every frame */
+    GL::Framebuffer mrt{{{}, size}};
+    mrt.attachRenderbuffer(GL::Framebuffer::ColorAttachment{0}, color)
+        .attachRenderbuffer(GL::Framebuffer::ColorAttachment{1}, objectId)
+        .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, depth)
+        .mapForDraw({{PhongIdShader::ColorOutput, GL::Framebuffer::ColorAttachment{0}},
+                     {PhongIdShader::ObjectIdOutput, GL::Framebuffer::ColorAttachment{1}}});
+
+    /* On-demand: just color every frame, IDs in a scissored region */
+    GL::Framebuffer colorOnly{{{}, size}};
+    colorOnly.attachRenderbuffer(GL::Framebuffer::ColorAttachment{0}, color)
+        .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, depth)
+        .mapForDraw({{PhongIdShader::ColorOutput, GL::Framebuffer::ColorAttachment{0}},
+                     {PhongIdShader::ObjectIdOutput, GL::Framebuffer::DrawAttachment::None}});
+    GL::Framebuffer ids{{{}, size}};
+    ids.attachRenderbuffer(GL::Framebuffer::ColorAttachment{0}, objectId)
+        .attachRenderbuffer(GL::Framebuffer::BufferAttachment::Depth, depth)
+        .mapForDraw({{PhongIdShader::ColorOutput, GL::Framebuffer::DrawAttachment::None},
+                     {PhongIdShader::ObjectIdOutput, GL::Framebuffer::ColorAttachment{0}}});
+
+    const Vector2i viewport = _camera->viewport();
+    _camera->setViewport(size);
+
+    GL::TimeQuery query{GL::TimeQuery::Target::TimeElapsed};
+
+    query.begin();
+    for(Int i = 0; i != Iterations; ++i) {
+        mrt.clearColor(PhongIdShader::ColorOutput, Color3{0.125f})
+            .clearColor(PhongIdShader::ObjectIdOutput, Vector4ui{})
+            .clearDepth(1.0f)
+            .bind();
+        _camera->draw(_drawables);
+    }
+    query.end();
+    const Double alwaysOn = query.result<UnsignedLong>()/1.0e6/Iterations;
+
+    /* Pick in every frame to get the worst case */
+    query.begin();
+    for(Int i = 0; i != Iterations; ++i) {
+        colorOnly.clearColor(PhongIdShader::ColorOutput, Color3{0.125f})
+            .clearDepth(1.0f)
+            .bind();
+        _camera->draw(_drawables);
+        drawIds(ids, Range2Di::fromSize(size/2, {1, 1}));
+    }
+    query.end();
+    const Double onDemand = query.result<UnsignedLong>()/1.0e6/Iterations;
+
+    /* Synchronous framebuffer read right after submitting a frame, which is
+       what a click handler would do. It has to wait until the GPU finishes
+       the frame. */
+    std::minstd_rand random;
+    std::uniform_int_distribution<Int> x{0, size.x() - 1}, y{0, size.y() - 1};
+    const PixelFormat idFormat = _shader.flags() & PhongIdShader::Flag::PrimitiveIdDepth ?
+        PixelFormat::RGBA32UI : PixelFormat::R32UI;
+    mrt.mapForRead(GL::Framebuffer::ColorAttachment{1});
+    std::chrono::high_resolution_clock::duration readDuration{};
+    for(Int i = 0; i != Iterations; ++i) {
+        mrt.clearColor(PhongIdShader::ColorOutput, Color3{0.125f})
+            .clearColor(PhongIdShader::ObjectIdOutput, Vector4ui{})
+            .clearDepth(1.0f)
+            .bind();
+        _camera->draw(_drawables);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        mrt.read(Range2Di::fromSize({x(random), y(random)}, {1, 1}), Image2D{idFormat});
+        readDuration += std::chrono::high_resolution_clock::now() - start;
+    }
+
+    /* CPU ray casting doesn't depend on the GPU at all */
+    constexpr Int RaycastIterations = 10000;
+    Vector3 hitPosition;
+    UnsignedInt hitTriangle;
+    std::size_t hitCount = 0;
+    const auto raycastStart = std::chrono::high_resolution_clock::now();
+    for(Int i = 0; i != RaycastIterations; ++i)
+        if(raycast({x(random), y(random)}, size, hitPosition, hitTriangle))
+            ++hitCount;
+    const auto raycastDuration = std::chrono::high_resolution_clock::now() - raycastStart;
+
+    _camera->setViewport(viewport);
+    GL::defaultFramebuffer.bind();
+
+    Debug{} << "Picking at" << size << "averaged over" << Iterations << "frames:";
+    Debug{} << "    always-on ID attachment:" << alwaysOn << "ms per frame";
+    Debug{} << "    on-demand scissored ID pass:" << onDemand << "ms per frame";
+    Debug{} << "    synchronous framebuffer read:" << std::chrono::duration<Double, std::milli>(readDuration).count()/Iterations << "ms per pick";
+    Debug{} << "    CPU ray cast:" << std::chrono::duration<Double, std::milli>(raycastDuration).count()/RaycastIterations << "ms per pick," << hitCount << "of" << RaycastIterations << "rays hit";
+}
+
 }}
 
 MAGNUM_APPLICATION_MAIN(Magnum::Examples::PickingExample)
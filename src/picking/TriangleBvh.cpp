@@ -0,0 +1,313 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TriangleBvh.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Mesh.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Trade/MeshData3D.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MAGNUM_EXAMPLES_TRIANGLEBVH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Magnum { namespace Examples {
+
+namespace {
+    enum: std::size_t { LeafSize = 4, MaxDepth = 64 };
+
+    /* Distance at which the ray enters the box or infinity if it misses it
+       or enters it farther than maxDistance */
+    Float boxDistance(const Vector3& min, const Vector3& max, const Vector3& origin, const Vector3& inverseDirection, const Float maxDistance) {
+        Float entry = 0.0f;
+        Float exit = maxDistance;
+        for(std::size_t i = 0; i != 3; ++i) {
+            const Float t1 = (min[i] - origin[i])*inverseDirection[i];
+            const Float t2 = (max[i] - origin[i])*inverseDirection[i];
+
+            /* If the ray is parallel to the slab and the origin lies exactly
+               on its plane, one of the above is 0*inf, which is NaN. The ray
+               then runs along the box side, so this axis doesn't limit the
+               interval at all. */
+            if(t1 != t1 || t2 != t2) continue;
+
+            entry = Math::max(entry, Math::min(t1, t2));
+            exit = Math::min(exit, Math::max(t1, t2));
+        }
+        return entry <= exit ? entry : std::numeric_limits<Float>::infinity();
+    }
+}
+
+TriangleBvh::TriangleBvh(const Containers::ArrayView<const Vector3> positions, const Containers::ArrayView<const UnsignedInt> indices) {
+    build(positions, indices);
+}
+
+TriangleBvh::TriangleBvh(const Trade::MeshData3D& mesh) {
+    CORRADE_ASSERT(mesh.primitive() == MeshPrimitive::Triangles || mesh.primitive() == MeshPrimitive::TriangleStrip,
+        "TriangleBvh: unsupported primitive" << mesh.primitive(), );
+
+    const std::vector<Vector3>& positions = mesh.positions(0);
+    std::vector<UnsignedInt> indices;
+    if(mesh.isIndexed()) indices = mesh.indices();
+    else {
+        indices.resize(positions.size());
+        std::iota(indices.begin(), indices.end(), 0);
+    }
+
+    /* Convert a strip to a list. Winding doesn't matter as the triangles are
+       tested from both sides. */
+    if(mesh.primitive() == MeshPrimitive::TriangleStrip) {
+        std::vector<UnsignedInt> list;
+        for(std::size_t i = 2; i < indices.size(); ++i)
+            list.insert(list.end(), {indices[i - 2], indices[i - 1], indices[i]});
+        indices = std::move(list);
+    }
+
+    build(positions, indices);
+}
+
+void TriangleBvh::build(const Containers::ArrayView<const Vector3> positions, const Containers::ArrayView<const UnsignedInt> indices) {
+    CORRADE_ASSERT(indices.size() % 3 == 0,
+        "TriangleBvh: index count not divisible by 3", );
+
+    _triangleCount = indices.size()/3;
+    _nodes.clear();
+    _packets.clear();
+    if(!_triangleCount) return;
+
+    std::vector<Vector3> centroids(_triangleCount);
+    for(std::size_t i = 0; i != _triangleCount; ++i)
+        centroids[i] = (positions[indices[i*3 + 0]] +
+                        positions[indices[i*3 + 1]] +
+                        positions[indices[i*3 + 2]])/3.0f;
+
+    std::vector<UnsignedInt> order(_triangleCount);
+    std::iota(order.begin(), order.end(), 0);
+
+    _nodes.reserve(2*(_triangleCount/LeafSize + 1));
+    _packets.reserve(_triangleCount/LeafSize + 1);
+    _nodes.emplace_back();
+    buildNode(0, 0, _triangleCount, positions, indices, order, centroids);
+}
+
+void TriangleBvh::buildNode(const std::size_t nodeIndex, const std::size_t begin, const std::size_t end, const Containers::ArrayView<const Vector3> positions, const Containers::ArrayView<const UnsignedInt> indices, std::vector<UnsignedInt>& order, const std::vector<Vector3>& centroids) {
+    /* Bounds of the triangles and of their centroids */
+    Vector3 min{std::numeric_limits<Float>::max()}, max{std::numeric_limits<Float>::lowest()};
+    Vector3 centroidMin = min, centroidMax = max;
+    for(std::size_t i = begin; i != end; ++i) {
+        const UnsignedInt triangle = order[i];
+        for(std::size_t j = 0; j != 3; ++j) {
+            const Vector3& position = positions[indices[triangle*3 + j]];
+            min = Math::min(min, position);
+            max = Math::max(max, position);
+        }
+        centroidMin = Math::min(centroidMin, centroids[triangle]);
+        centroidMax = Math::max(centroidMax, centroids[triangle]);
+    }
+    _nodes[nodeIndex].min = min;
+    _nodes[nodeIndex].max = max;
+
+    /* Few enough triangles, make a leaf packet */
+    if(end - begin <= LeafSize) {
+        _nodes[nodeIndex].index = UnsignedInt(_packets.size());
+        _nodes[nodeIndex].count = UnsignedInt(end - begin);
+
+        _packets.emplace_back();
+        TrianglePacket& packet = _packets.back();
+        for(std::size_t lane = 0; lane != LeafSize; ++lane) {
+            Vector3 v0, edge1, edge2;
+            UnsignedInt triangle = 0;
+            if(begin + lane < end) {
+                triangle = order[begin + lane];
+                v0 = positions[indices[triangle*3 + 0]];
+                edge1 = positions[indices[triangle*3 + 1]] - v0;
+                edge2 = positions[indices[triangle*3 + 2]] - v0;
+            }
+            for(std::size_t axis = 0; axis != 3; ++axis) {
+                packet.v0[axis][lane] = v0[axis];
+                packet.edge1[axis][lane] = edge1[axis];
+                packet.edge2[axis][lane] = edge2[axis];
+            }
+            packet.triangle[lane] = triangle;
+        }
+        return;
+    }
+
+    /* Split at the median centroid along the longest axis */
+    const Vector3 extent = centroidMax - centroidMin;
+    const std::size_t axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 :
+                             extent.y() >= extent.z() ? 1 : 2;
+    const std::size_t middle = begin + (end - begin)/2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+        [&](UnsignedInt a, UnsignedInt b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    /* The vector may reallocate, so refer to the nodes by index only */
+    const std::size_t first = _nodes.size();
+    _nodes.emplace_back();
+    _nodes.emplace_back();
+    _nodes[nodeIndex].index = UnsignedInt(first);
+    _nodes[nodeIndex].count = 0;
+    buildNode(first, begin, middle, positions, indices, order, centroids);
+    buildNode(first + 1, middle, end, positions, indices, order, centroids);
+}
+
+bool TriangleBvh::intersect(const Vector3& origin, const Vector3& direction, const Float maxDistance, Hit& hit) const {
+    if(_nodes.empty()) return false;
+
+    const Vector3 inverseDirection = Vector3{1.0f}/direction;
+    Float closest = maxDistance;
+    bool found = false;
+
+    #ifdef MAGNUM_EXAMPLES_TRIANGLEBVH_SSE2
+    const __m128 ox = _mm_set1_ps(origin.x()),
+                 oy = _mm_set1_ps(origin.y()),
+                 oz = _mm_set1_ps(origin.z()),
+                 dx = _mm_set1_ps(direction.x()),
+                 dy = _mm_set1_ps(direction.y()),
+                 dz = _mm_set1_ps(direction.z());
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    #endif
+
+    if(boxDistance(_nodes[0].min, _nodes[0].max, origin, inverseDirection, closest) == std::numeric_limits<Float>::infinity())
+        return false;
+
+    UnsignedInt stack[MaxDepth];
+    std::size_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while(stackSize) {
+        const Node& node = _nodes[stack[--stackSize]];
+
+        /* Leaf, test all triangles in the packet at once using
+           Möller-Trumbore */
+        if(node.count) {
+            const TrianglePacket& p = _packets[node.index];
+            Float distances[LeafSize];
+            int hits = 0;
+
+            #ifdef MAGNUM_EXAMPLES_TRIANGLEBVH_SSE2
+            const __m128 e1x = _mm_loadu_ps(p.edge1[0]),
+                         e1y = _mm_loadu_ps(p.edge1[1]),
+                         e1z = _mm_loadu_ps(p.edge1[2]),
+                         e2x = _mm_loadu_ps(p.edge2[0]),
+                         e2y = _mm_loadu_ps(p.edge2[1]),
+                         e2z = _mm_loadu_ps(p.edge2[2]);
+
+            /* pvec = direction × edge2, determinant = edge1 · pvec */
+            const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y)),
+                         py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z)),
+                         pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            const __m128 determinant = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            const __m128 inverseDeterminant = _mm_div_ps(one, determinant);
+
+            /* tvec = origin - v0, u = tvec · pvec */
+            const __m128 tx = _mm_sub_ps(ox, _mm_loadu_ps(p.v0[0])),
+                         ty = _mm_sub_ps(oy, _mm_loadu_ps(p.v0[1])),
+                         tz = _mm_sub_ps(oz, _mm_loadu_ps(p.v0[2]));
+            const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), inverseDeterminant);
+
+            /* qvec = tvec × edge1, v = direction · qvec, t = edge2 · qvec */
+            const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y)),
+                         qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z)),
+                         qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+            const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverseDeterminant);
+            const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverseDeterminant);
+
+            /* Degenerate lanes have zero determinant and fail the first test,
+               NaNs fail all comparisons */
+            __m128 mask = _mm_cmpgt_ps(_mm_andnot_ps(signMask, determinant), zero);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(t, zero));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(closest)));
+            hits = _mm_movemask_ps(mask);
+            _mm_storeu_ps(distances, t);
+            #else
+            for(std::size_t lane = 0; lane != LeafSize; ++lane) {
+                const Vector3 edge1{p.edge1[0][lane], p.edge1[1][lane], p.edge1[2][lane]};
+                const Vector3 edge2{p.edge2[0][lane], p.edge2[1][lane], p.edge2[2][lane]};
+                const Vector3 pvec = Math::cross(direction, edge2);
+                const Float determinant = Math::dot(edge1, pvec);
+                if(determinant == 0.0f) continue;
+                const Float inverseDeterminant = 1.0f/determinant;
+
+                const Vector3 tvec = origin - Vector3{p.v0[0][lane], p.v0[1][lane], p.v0[2][lane]};
+                const Float u = Math::dot(tvec, pvec)*inverseDeterminant;
+                const Vector3 qvec = Math::cross(tvec, edge1);
+                const Float v = Math::dot(direction, qvec)*inverseDeterminant;
+                const Float t = Math::dot(edge2, qvec)*inverseDeterminant;
+                if(u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < closest) {
+                    hits |= 1 << lane;
+                    distances[lane] = t;
+                }
+            }
+            #endif
+
+            for(std::size_t lane = 0; lane != LeafSize; ++lane) {
+                if(!(hits & (1 << lane)) || distances[lane] >= closest) continue;
+                closest = distances[lane];
+                hit = {distances[lane], p.triangle[lane]};
+                found = true;
+            }
+
+            continue;
+        }
+
+        /* Inner node, visit the closer child first so the farther one can be
+           culled by a closer hit */
+        const Node& a = _nodes[node.index];
+        const Node& b = _nodes[node.index + 1];
+        Float distanceA = boxDistance(a.min, a.max, origin, inverseDirection, closest);
+        Float distanceB = boxDistance(b.min, b.max, origin, inverseDirection, closest);
+        UnsignedInt closer = node.index, farther = node.index + 1;
+        if(distanceB < distanceA) {
+            std::swap(distanceA, distanceB);
+            std::swap(closer, farther);
+        }
+        CORRADE_INTERNAL_ASSERT(stackSize + 2 <= MaxDepth);
+        if(distanceB != std::numeric_limits<Float>::infinity())
+            stack[stackSize++] = farther;
+        if(distanceA != std::numeric_limits<Float>::infinity())
+            stack[stackSize++] = closer;
+    }
+
+    return found;
+}
+
+}}
@@ -0,0 +1,127 @@
+#ifndef Magnum_Examples_TriangleBvh_h
+#define Magnum_Examples_TriangleBvh_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <vector>
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/Magnum.h>
+#include <Magnum/Math/Vector3.h>
+#include <Magnum/Trade/Trade.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Bounding volume hierarchy of triangles for CPU ray casting
+
+Triangles are split by the median centroid along the longest axis until at
+most four are left in a leaf. Triangles of each leaf are stored together in
+a structure-of-arrays packet and tested against the ray all at once using SSE
+if available, so one leaf costs about the same as a single triangle test.
+
+The hierarchy doesn't depend on anything else from the example, so it can be
+used for picking in any application that has the mesh data on the CPU.
+*/
+class TriangleBvh {
+    public:
+        /** @brief Ray hit */
+        struct Hit {
+            /**
+             * Ray parameter of the hit. The hit position is
+             * @cpp origin + direction*distance @ce, so it's in units of
+             * direction length.
+             */
+            Float distance;
+
+            /** Index of the triangle in the original triangle list */
+            UnsignedInt triangle;
+        };
+
+        /**
+         * @brief Construct from an indexed triangle list
+         * @param positions Vertex positions
+         * @param indices   Triangle indices, three for each triangle
+         */
+        explicit TriangleBvh(Containers::ArrayView<const Vector3> positions, Containers::ArrayView<const UnsignedInt> indices);
+
+        /**
+         * @brief Construct from mesh data
+         *
+         * Accepts indexed or non-indexed @ref MeshPrimitive::Triangles and
+         * @ref MeshPrimitive::TriangleStrip, which is converted to a triangle
+         * list first. Only the first position array is used.
+         */
+        explicit TriangleBvh(const Trade::MeshData3D& mesh);
+
+        /** @brief Triangle count */
+        std::size_t triangleCount() const { return _triangleCount; }
+
+        /** @brief Node count */
+        std::size_t nodeCount() const { return _nodes.size(); }
+
+        /**
+         * @brief Intersect with a ray
+         *
+         * Finds the closest triangle hit by the ray with a parameter between
+         * @cpp 0 @ce and @p maxDistance. Triangles are tested from both
+         * sides. The @p direction doesn't need to be normalized. Returns
+         * @cpp false @ce and doesn't touch @p hit if nothing is hit.
+         */
+        bool intersect(const Vector3& origin, const Vector3& direction, Float maxDistance, Hit& hit) const;
+
+    private:
+        /* Leaf if count is non-zero, index is then the packet index.
+           Otherwise index is the first of two adjacent children. */
+        struct Node {
+            Vector3 min;
+            UnsignedInt index;
+            Vector3 max;
+            UnsignedInt count;
+        };
+
+        /* Up to four triangles as structure of arrays, unused lanes have all
+           zeros, which is a degenerate triangle that's never hit */
+        struct TrianglePacket {
+            Float v0[3][4];
+            Float edge1[3][4];
+            Float edge2[3][4];
+            UnsignedInt triangle[4];
+        };
+
+        void build(Containers::ArrayView<const Vector3> positions, Containers::ArrayView<const UnsignedInt> indices);
+        void buildNode(std::size_t nodeIndex, std::size_t begin, std::size_t end, Containers::ArrayView<const Vector3> positions, Containers::ArrayView<const UnsignedInt> indices, std::vector<UnsignedInt>& order, const std::vector<Vector3>& centroids);
+
+        std::vector<Node> _nodes;
+        std::vector<TrianglePacket> _packets;
+        std::size_t _triangleCount;
+};
+
+}}
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "DebugLines.h"
 
+#include <algorithm>
 #include <Magnum/GL/Renderer.h>
 #include <Magnum/SceneGraph/Camera.h>
 
@@ -37,26 +38,86 @@
 
 namespace Magnum { namespace Examples {
 
-DebugLines::DebugLines(): _mesh{GL::MeshPrimitive::Lines} {
-    _mesh.addVertexBuffer(_buffer, 0,
-        Shaders::VertexColor3D::Position{},
-        Shaders::VertexColor3D::Color3{});
+namespace {
+
+/* Eight corners as returned by ShadowLight::frustumCorners() followed by
+   the near plane mid point */
+enum: UnsignedInt {
+    FrustumVertexCount = 9,
+    FrustumIndexCount = 32
+};
+
+constexpr UnsignedInt FrustumIndices[]{
+    8, 1, 8, 3, 8, 2, 8, 0,
+    0, 1, 1, 3, 3, 2, 2, 0,
+    0, 4, 1, 5, 2, 6, 3, 7,
+    4, 5, 5, 7, 7, 6, 6, 4
+};
+
+static_assert(sizeof(FrustumIndices)/sizeof(UnsignedInt) == FrustumIndexCount, "");
+
 }
 
+DebugLines::DebugLines(): _lines{1024*sizeof(Point)}, _frusta{64*FrustumVertexCount*sizeof(Point)}, _frustumIndices{GL::Buffer::TargetHint::ElementArray} {}
+
 void DebugLines::reset() {
-    _lines.clear();
-    _buffer.invalidateData();
+    _lines.begin();
+    _frusta.begin();
 }
 
 void DebugLines::draw(const Matrix4& transformationProjectionMatrix) {
-    if(!_lines.empty()) {
-        GL::Renderer::disable(GL::Renderer::Feature::DepthTest);
-        _buffer.setData(_lines, GL::BufferUsage::StreamDraw);
-        _mesh.setCount(_lines.size());
-        _shader.setTransformationProjectionMatrix(transformationProjectionMatrix);
+    if(!_lines.size() && !_frusta.size()) return;
+
+    GL::Renderer::disable(GL::Renderer::Feature::DepthTest);
+    _shader.setTransformationProjectionMatrix(transformationProjectionMatrix);
+
+    if(_lines.size()) {
+        /* The stream got reallocated since last time, attach the new buffer */
+        if(_meshBufferId != _lines.buffer().id()) {
+            _mesh = GL::Mesh{GL::MeshPrimitive::Lines};
+            _mesh.addVertexBuffer(_lines.buffer(), 0,
+                Shaders::VertexColor3D::Position{},
+                Shaders::VertexColor3D::Color3{});
+            _meshBufferId = _lines.buffer().id();
+        }
+
+        _lines.flush();
+        _mesh.setBaseVertex(_lines.regionOffset()/sizeof(Point))
+            .setCount(_lines.size()/sizeof(Point));
         _mesh.draw(_shader);
-        GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
+        _lines.fence();
+    }
+
+    if(_frusta.size()) {
+        const std::size_t frustumCount = _frusta.size()/(FrustumVertexCount*sizeof(Point));
+
+        /* The index pattern is the same for all frusta, just offset. Grow it
+           only if there's more frusta than ever before. */
+        if(frustumCount > _frustumIndexCapacity) {
+            _frustumIndexCapacity = std::max(2*_frustumIndexCapacity, frustumCount);
+            Containers::Array<UnsignedInt> indices{Containers::NoInit, _frustumIndexCapacity*FrustumIndexCount};
+            for(std::size_t i = 0; i != indices.size(); ++i)
+                indices[i] = FrustumIndices[i % FrustumIndexCount] + UnsignedInt(i/FrustumIndexCount)*FrustumVertexCount;
+            _frustumIndices.setData(indices, GL::BufferUsage::StaticDraw);
+        }
+
+        if(_frustumMeshBufferId != _frusta.buffer().id()) {
+            _frustumMesh = GL::Mesh{GL::MeshPrimitive::Lines};
+            _frustumMesh.addVertexBuffer(_frusta.buffer(), 0,
+                    Shaders::VertexColor3D::Position{},
+                    Shaders::VertexColor3D::Color3{})
+                .setIndexBuffer(_frustumIndices, 0, MeshIndexType::UnsignedInt);
+            _frustumMeshBufferId = _frusta.buffer().id();
+        }
+
+        _frusta.flush();
+        _frustumMesh.setBaseVertex(_frusta.regionOffset()/sizeof(Point))
+            .setCount(frustumCount*FrustumIndexCount);
+        _frustumMesh.draw(_shader);
+        _frusta.fence();
     }
+
+    GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
 }
 
 void DebugLines::addFrustum(const Matrix4& imvp, const Color3& col) {
@@ -64,32 +125,24 @@ void DebugLines::addFrustum(const Matrix4& imvp, const Color3& col) {
 }
 
 void DebugLines::addFrustum(const Matrix4& imvp, const Color3& col, const Float z0, const Float z1) {
-    auto worldPointsToCover = ShadowLight::frustumCorners(imvp, z0, z1);
-
-    auto nearMid = (worldPointsToCover[0] +
-                    worldPointsToCover[1] +
-                    worldPointsToCover[3] +
-                    worldPointsToCover[2])*0.25f;
-
-    addLine(nearMid, worldPointsToCover[1], col);
-    addLine(nearMid, worldPointsToCover[3], col);
-    addLine(nearMid, worldPointsToCover[2], col);
-    addLine(nearMid, worldPointsToCover[0], col);
-
-    addLine(worldPointsToCover[0], worldPointsToCover[1], col);
-    addLine(worldPointsToCover[1], worldPointsToCover[3], col);
-    addLine(worldPointsToCover[3], worldPointsToCover[2], col);
-    addLine(worldPointsToCover[2], worldPointsToCover[0], col);
-
-    addLine(worldPointsToCover[0], worldPointsToCover[4], col);
-    addLine(worldPointsToCover[1], worldPointsToCover[5], col);
-    addLine(worldPointsToCover[2], worldPointsToCover[6], col);
-    addLine(worldPointsToCover[3], worldPointsToCover[7], col);
-
-    addLine(worldPointsToCover[4], worldPointsToCover[5], col);
-    addLine(worldPointsToCover[5], worldPointsToCover[7], col);
-    addLine(worldPointsToCover[7], worldPointsToCover[6], col);
-    addLine(worldPointsToCover[6], worldPointsToCover[4], col);
+    const Frustum frustum{imvp, col, z0, z1};
+    addFrusta({&frustum, 1});
+}
+
+void DebugLines::addFrusta(const Containers::ArrayView<const Frustum> frusta) {
+    Containers::ArrayView<Point> out = Containers::arrayCast<Point>(
+        _frusta.allocate(frusta.size()*FrustumVertexCount*sizeof(Point)));
+
+    Vector3 corners[8];
+    for(std::size_t i = 0; i != frusta.size(); ++i) {
+        const Frustum& frustum = frusta[i];
+        ShadowLight::frustumCorners(frustum.imvp, frustum.z0, frustum.z1, corners);
+
+        Point* points = out.data() + i*FrustumVertexCount;
+        for(std::size_t j = 0; j != 8; ++j)
+            points[j] = {corners[j], frustum.color};
+        points[8] = {(corners[0] + corners[1] + corners[3] + corners[2])*0.25f, frustum.color};
+    }
 }
 
 }}
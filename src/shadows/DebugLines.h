@@ -35,6 +35,8 @@
 #include <Magnum/SceneGraph/SceneGraph.h>
 #include <Magnum/Shaders/VertexColor.h>
 
+#include "StreamingBuffer.h"
+
 namespace Magnum { namespace Examples {
 
 class DebugLines {
@@ -44,13 +46,32 @@ class DebugLines {
             Color3 color;
         };
 
+        /**
+         * @brief Frustum to draw
+         *
+         * The @cpp z0 @ce and @cpp z1 @ce are NDC depths of the near and
+         * far plane to draw.
+         */
+        struct Frustum {
+            Matrix4 imvp;
+            Color3 color;
+            Float z0, z1;
+        };
+
         explicit DebugLines();
 
+        /**
+         * @brief Start a new frame
+         *
+         * Discards all lines added so far. Might wait for the GPU to finish
+         * drawing lines from a few frames back.
+         */
         void reset();
 
         void addLine(const Point& p0, const Point& p1) {
-            _lines.push_back(p0);
-            _lines.push_back(p1);
+            Containers::ArrayView<Point> out = Containers::arrayCast<Point>(_lines.allocate(2*sizeof(Point)));
+            out[0] = p0;
+            out[1] = p1;
         }
 
         void addLine(const Vector3& p0, const Vector3& p1, const Color3& col) {
@@ -60,12 +81,22 @@ class DebugLines {
         void addFrustum(const Matrix4& imvp, const Color3& col);
         void addFrustum(const Matrix4& imvp, const Color3& col, Float z0, Float z1);
 
+        /**
+         * @brief Add many frusta at once
+         *
+         * Writes just the nine unique points of each frustum, the lines are
+         * drawn from a shared index buffer.
+         */
+        void addFrusta(Containers::ArrayView<const Frustum> frusta);
+
         void draw(const Matrix4& transformationProjectionMatrix);
 
     protected:
-        std::vector<Point> _lines;
-        GL::Buffer _buffer;
-        GL::Mesh _mesh;
+        StreamingBuffer _lines, _frusta;
+        GL::Mesh _mesh{NoCreate}, _frustumMesh{NoCreate};
+        GLuint _meshBufferId{}, _frustumMeshBufferId{};
+        GL::Buffer _frustumIndices;
+        std::size_t _frustumIndexCapacity{};
         Shaders::VertexColor3D _shader;
 };
 
@@ -0,0 +1,108 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DepthPyramid.h"
+
+#include <Corrade/Containers/Reference.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/ImageFormat.h>
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/GL/Version.h>
+#include <Magnum/Math/Functions.h>
+#include <Magnum/Math/Vector3.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+    enum: UnsignedInt { WorkgroupSize = 8 };
+}
+
+DepthPyramid::ReduceShader::ReduceShader(const bool fromDepth) {
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL430);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    GL::Shader comp{GL::Version::GL430, GL::Shader::Type::Compute};
+    if(fromDepth) comp.addSource("#define FROM_DEPTH\n");
+    comp.addSource(rs.get("DepthPyramid.comp"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(comp.compile());
+
+    attachShader(comp);
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    setUniform(uniformLocation("source"), SourceUnit);
+    setUniform(uniformLocation("destination"), DestinationUnit);
+}
+
+DepthPyramid::DepthPyramid(NoCreateT): _fromDepthShader{NoCreate}, _reduceShader{NoCreate}, _texture{NoCreate}, _levelCount{} {}
+
+DepthPyramid::DepthPyramid(const Vector2i& depthSize): _fromDepthShader{true}, _reduceShader{false} {
+    _size = {1 << Math::log2(UnsignedInt(depthSize.x())),
+             1 << Math::log2(UnsignedInt(depthSize.y()))};
+    _levelCount = Math::log2(UnsignedInt(_size.max())) + 1;
+
+    /* Nearest filtering, we don't want to average any depth values */
+    _texture.setStorage(_levelCount, GL::TextureFormat::R32F, _size)
+        .setMinificationFilter(GL::SamplerFilter::Nearest, GL::SamplerMipmap::Nearest)
+        .setMagnificationFilter(GL::SamplerFilter::Nearest)
+        .setWrapping(GL::SamplerWrapping::ClampToEdge);
+}
+
+void DepthPyramid::build(GL::Texture2D& depth) {
+    /* The first level is calculated from the depth buffer, all others from
+       the previous level */
+    Vector2i size = _size;
+    for(Int level = 0; level != _levelCount; ++level) {
+        ReduceShader* shader;
+        if(level == 0) {
+            depth.bind(ReduceShader::SourceUnit);
+            shader = &_fromDepthShader;
+        } else {
+            _texture.bindImage(ReduceShader::SourceUnit, level - 1, GL::ImageAccess::ReadOnly, GL::ImageFormat::R32F);
+            shader = &_reduceShader;
+        }
+        _texture.bindImage(ReduceShader::DestinationUnit, level, GL::ImageAccess::WriteOnly, GL::ImageFormat::R32F);
+
+        shader->dispatchCompute({(Vector2ui{size} + Vector2ui{WorkgroupSize - 1})/WorkgroupSize, 1});
+
+        /* Next level needs to see the results of this one */
+        GL::Renderer::setMemoryBarrier(GL::Renderer::MemoryBarrier::ShaderImageAccess);
+        size = Math::max(size/2, Vector2i{1});
+    }
+
+    /* The culling shader samples the result as a regular texture */
+    GL::Renderer::setMemoryBarrier(GL::Renderer::MemoryBarrier::TextureFetch);
+}
+
+}}
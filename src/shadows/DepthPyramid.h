@@ -0,0 +1,95 @@
+#ifndef Magnum_Examples_DepthPyramid_h
+#define Magnum_Examples_DepthPyramid_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/Math/Vector2.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Hierarchical depth buffer
+
+A full mip chain of a depth buffer where each texel contains the farthest
+depth of the area it covers, built with a compute shader. The first level is
+the depth buffer size rounded down to a power of two, so each level halves
+the previous one. Requires OpenGL 4.3.
+*/
+class DepthPyramid {
+    public:
+        explicit DepthPyramid(NoCreateT);
+
+        /**
+         * @brief Constructor
+         * @param depthSize     Size of the depth buffer the pyramid will be
+         *      built from
+         */
+        explicit DepthPyramid(const Vector2i& depthSize);
+
+        /** @brief Size of the first level */
+        Vector2i size() const { return _size; }
+
+        /** @brief Level count */
+        Int levelCount() const { return _levelCount; }
+
+        /** @brief Pyramid texture */
+        GL::Texture2D& texture() { return _texture; }
+
+        /**
+         * @brief Build the pyramid
+         *
+         * The @p depth texture is expected to be a depth texture of the size
+         * passed in the constructor with comparison mode disabled.
+         */
+        void build(GL::Texture2D& depth);
+
+    private:
+        class ReduceShader: public GL::AbstractShaderProgram {
+            public:
+                enum: Int {
+                    SourceUnit = 0,
+                    DestinationUnit = 1
+                };
+
+                explicit ReduceShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+                explicit ReduceShader(bool fromDepth);
+        };
+
+        ReduceShader _fromDepthShader, _reduceShader;
+        GL::Texture2D _texture;
+        Vector2i _size;
+        Int _levelCount;
+};
+
+}}
+
+#endif
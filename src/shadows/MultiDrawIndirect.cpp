@@ -0,0 +1,59 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "MultiDrawIndirect.h"
+
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/GL/OpenGL.h>
+
+namespace Magnum { namespace Examples {
+
+static_assert(sizeof(DrawCommand) == 20, "draw command layout doesn't match GL");
+
+void multiDrawIndirect(GL::Mesh& mesh, GL::AbstractShaderProgram& shader, GL::Buffer& commands, const std::size_t offset, const std::size_t drawCount) {
+    if(!drawCount) return;
+
+    /* Make sure we don't accidentally modify a VAO Magnum has bound */
+    GL::Context::current().resetState(GL::Context::State::EnterExternal);
+
+    glUseProgram(shader.id());
+    glBindVertexArray(mesh.id());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands.id());
+    glMultiDrawElementsIndirect(GLenum(mesh.primitive()), GL_UNSIGNED_INT,
+        reinterpret_cast<const GLvoid*>(offset), GLsizei(drawCount), 0);
+    glBindVertexArray(0);
+
+    /* Magnum doesn't know what's bound now */
+    GL::Context::current().resetState(GL::Context::State::ExitExternal);
+}
+
+}}
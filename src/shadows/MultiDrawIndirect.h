@@ -0,0 +1,67 @@
+#ifndef Magnum_Examples_MultiDrawIndirect_h
+#define Magnum_Examples_MultiDrawIndirect_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Magnum/GL/GL.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Indexed indirect draw command
+
+Layout matches @m_class{m-doc-external} [DrawElementsIndirectCommand](https://www.khronos.org/opengl/wiki/Vertex_Rendering#Indirect_rendering).
+Base instance is commonly used to tell the shader which object it's drawing,
+together with an instanced attribute containing consecutive numbers.
+*/
+struct DrawCommand {
+    UnsignedInt count;
+    UnsignedInt instanceCount;
+    UnsignedInt firstIndex;
+    Int baseVertex;
+    UnsignedInt baseInstance;
+};
+
+/**
+@brief Draw a mesh with commands sourced from a buffer
+
+The @p mesh is expected to be indexed with @ref MeshIndexType::UnsignedInt,
+the @p commands buffer contains @p drawCount tightly packed
+@ref DrawCommand structures starting at @p offset. All uniforms, textures and
+buffers used by the @p shader have to be set up before calling this function.
+
+There's no wrapper for indirect draws in @ref GL::Mesh, so this binds the
+mesh and the shader directly and resets the context state tracker
+afterwards. Requires OpenGL 4.3.
+*/
+void multiDrawIndirect(GL::Mesh& mesh, GL::AbstractShaderProgram& shader, GL::Buffer& commands, std::size_t offset, std::size_t drawCount);
+
+}}
+
+#endif
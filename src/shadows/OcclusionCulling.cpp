@@ -0,0 +1,168 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "OcclusionCulling.h"
+
+#include <Corrade/Containers/Reference.h>
+#include <Corrade/Utility/Resource.h>
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Renderer.h>
+#include <Magnum/GL/Shader.h>
+#include <Magnum/GL/Texture.h>
+#include <Magnum/GL/Version.h>
+#include <Magnum/Math/Vector3.h>
+
+#include "DepthPyramid.h"
+#include "MultiDrawIndirect.h"
+
+namespace Magnum { namespace Examples {
+
+namespace {
+    enum: UnsignedInt { WorkgroupSize = 64 };
+}
+
+static_assert(sizeof(OcclusionCulling::Object) == 32, "object layout doesn't match std430");
+
+OcclusionCulling::CullingShader::CullingShader() {
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL430);
+
+    const Utility::Resource rs{"shadow-data"};
+
+    GL::Shader comp{GL::Version::GL430, GL::Shader::Type::Compute};
+    comp.addSource(rs.get("OcclusionCulling.comp"));
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(comp.compile());
+
+    attachShader(comp);
+
+    CORRADE_INTERNAL_ASSERT_OUTPUT(link());
+
+    _objectCountUniform = uniformLocation("objectCount");
+    _cameraMatrixUniform = uniformLocation("cameraMatrix");
+    _clipPlanesUniform = uniformLocation("clipPlanes");
+    _occlusionEnabledUniform = uniformLocation("occlusionEnabled");
+    _pyramidCameraMatrixUniform = uniformLocation("pyramidCameraMatrix");
+    _pyramidProjectionMatrixUniform = uniformLocation("pyramidProjectionMatrix");
+    _pyramidNearUniform = uniformLocation("pyramidNear");
+    _pyramidSizeUniform = uniformLocation("pyramidSize");
+
+    setUniform(uniformLocation("depthPyramid"), DepthPyramidUnit);
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setObjectCount(const UnsignedInt count) {
+    setUniform(_objectCountUniform, count);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setCameraMatrix(const Matrix4& matrix) {
+    setUniform(_cameraMatrixUniform, matrix);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setClipPlanes(const Containers::ArrayView<const Vector4> planes) {
+    setUniform(_clipPlanesUniform, planes);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setOcclusionEnabled(const bool enabled) {
+    setUniform(_occlusionEnabledUniform, Int(enabled));
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setPyramidCameraMatrix(const Matrix4& matrix) {
+    setUniform(_pyramidCameraMatrixUniform, matrix);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setPyramidProjectionMatrix(const Matrix4& matrix) {
+    setUniform(_pyramidProjectionMatrixUniform, matrix);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setPyramidNear(const Float distance) {
+    setUniform(_pyramidNearUniform, distance);
+    return *this;
+}
+
+OcclusionCulling::CullingShader& OcclusionCulling::CullingShader::setPyramidSize(const Vector2& size) {
+    setUniform(_pyramidSizeUniform, size);
+    return *this;
+}
+
+OcclusionCulling::OcclusionCulling(NoCreateT): _shader{NoCreate}, _objects{NoCreate}, _commands{NoCreate}, _objectCount{} {}
+
+OcclusionCulling::OcclusionCulling(): _commands{GL::Buffer::TargetHint::DrawIndirect}, _objectCount{} {}
+
+void OcclusionCulling::setObjects(const Containers::ArrayView<const Object> objects) {
+    _objects.setData(objects, GL::BufferUsage::StaticDraw);
+    _commands.setData({nullptr, objects.size()*sizeof(DrawCommand)}, GL::BufferUsage::DynamicCopy);
+    _objectCount = objects.size();
+}
+
+void OcclusionCulling::cull(const Matrix4& cameraMatrix, const Matrix4& projectionMatrix, DepthPyramid* const pyramid, const Matrix4& pyramidCameraMatrix, const Matrix4& pyramidProjectionMatrix) {
+    if(!_objectCount) return;
+
+    /* Camera-space frustum planes, props Gribb & Hartmann. Rows of the
+       projection matrix are columns of the transposed one. */
+    const Matrix4 rows = projectionMatrix.transposed();
+    Vector4 clipPlanes[]{
+        rows[3] + rows[2],  /* near */
+        rows[3] - rows[2],  /* far */
+        rows[3] + rows[0],  /* left */
+        rows[3] - rows[0],  /* right */
+        rows[3] + rows[1],  /* bottom */
+        rows[3] - rows[1]}; /* top */
+    for(Vector4& plane: clipPlanes)
+        plane /= plane.xyz().length();
+
+    _shader.setObjectCount(UnsignedInt(_objectCount))
+        .setCameraMatrix(cameraMatrix)
+        .setClipPlanes(clipPlanes)
+        .setOcclusionEnabled(pyramid != nullptr);
+
+    if(pyramid) {
+        /* Near plane distance of a perspective projection */
+        const Float pyramidNear = pyramidProjectionMatrix[3][2]/(pyramidProjectionMatrix[2][2] - 1.0f);
+
+        _shader.setPyramidCameraMatrix(pyramidCameraMatrix)
+            .setPyramidProjectionMatrix(pyramidProjectionMatrix)
+            .setPyramidNear(pyramidNear)
+            .setPyramidSize(Vector2{pyramid->size()});
+        pyramid->texture().bind(CullingShader::DepthPyramidUnit);
+    }
+
+    _objects.bind(GL::Buffer::Target::ShaderStorage, CullingShader::ObjectBufferBinding);
+    _commands.bind(GL::Buffer::Target::ShaderStorage, CullingShader::CommandBufferBinding);
+    _shader.dispatchCompute({(UnsignedInt(_objectCount) + WorkgroupSize - 1)/WorkgroupSize, 1, 1});
+
+    /* The commands are consumed by an indirect draw next */
+    GL::Renderer::setMemoryBarrier(GL::Renderer::MemoryBarrier::Command);
+}
+
+}}
@@ -0,0 +1,145 @@
+#ifndef Magnum_Examples_OcclusionCulling_h
+#define Magnum_Examples_OcclusionCulling_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Corrade/Containers/ArrayView.h>
+#include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/Math/Matrix4.h>
+
+namespace Magnum { namespace Examples {
+
+class DepthPyramid;
+
+/**
+@brief GPU frustum and occlusion culling
+
+Tests bounding spheres of all objects against the camera frustum and a
+@ref DepthPyramid from the previous frame in a compute shader, writing one
+indirect draw command per object into @ref commands(). Culled objects get an
+instance count of zero, so the whole buffer can be submitted with a single
+multi-draw without reading anything back. Requires OpenGL 4.3.
+*/
+class OcclusionCulling {
+    public:
+        /**
+         * @brief Object to cull
+         *
+         * Layout matches the `Object` structure in the compute shader.
+         */
+        struct Object {
+            /* World-space center and radius */
+            Vector4 sphere;
+            UnsignedInt indexCount;
+            UnsignedInt indexOffset;
+            Int baseVertex;
+            /* Pads the struct to a multiple of 16 bytes, as std430 needs */
+            UnsignedInt padding;
+        };
+
+        explicit OcclusionCulling(NoCreateT);
+
+        explicit OcclusionCulling();
+
+        /** @brief Upload the objects to cull */
+        void setObjects(Containers::ArrayView<const Object> objects);
+
+        std::size_t objectCount() const { return _objectCount; }
+
+        /**
+         * @brief Cull the objects
+         * @param cameraMatrix          Camera matrix of the frame being
+         *      rendered
+         * @param projectionMatrix      Perspective projection matrix of the
+         *      frame being rendered
+         * @param pyramid               Depth pyramid to test against or
+         *      @cpp nullptr @ce for just frustum culling
+         * @param pyramidCameraMatrix   Camera matrix the pyramid depth was
+         *      rendered with
+         * @param pyramidProjectionMatrix Perspective projection matrix the
+         *      pyramid depth was rendered with
+         *
+         * Testing against the camera the depth was actually rendered with
+         * keeps the culling conservative when the camera moves --- objects
+         * that were not on the screen in the previous frame are never
+         * considered occluded.
+         */
+        void cull(const Matrix4& cameraMatrix, const Matrix4& projectionMatrix, DepthPyramid* pyramid, const Matrix4& pyramidCameraMatrix, const Matrix4& pyramidProjectionMatrix);
+
+        /**
+         * @brief Draw commands written by @ref cull()
+         *
+         * Contains one @ref DrawCommand for each object, with base instance
+         * set to the object index.
+         */
+        GL::Buffer& commands() { return _commands; }
+
+    private:
+        class CullingShader: public GL::AbstractShaderProgram {
+            public:
+                enum: UnsignedInt {
+                    ObjectBufferBinding = 1,
+                    CommandBufferBinding = 2
+                };
+
+                enum: Int { DepthPyramidUnit = 0 };
+
+                explicit CullingShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+                explicit CullingShader();
+
+                CullingShader& setObjectCount(UnsignedInt count);
+                CullingShader& setCameraMatrix(const Matrix4& matrix);
+                CullingShader& setClipPlanes(Containers::ArrayView<const Vector4> planes);
+                CullingShader& setOcclusionEnabled(bool enabled);
+                CullingShader& setPyramidCameraMatrix(const Matrix4& matrix);
+                CullingShader& setPyramidProjectionMatrix(const Matrix4& matrix);
+                CullingShader& setPyramidNear(Float distance);
+                CullingShader& setPyramidSize(const Vector2& size);
+
+            private:
+                Int _objectCountUniform,
+                    _cameraMatrixUniform,
+                    _clipPlanesUniform,
+                    _occlusionEnabledUniform,
+                    _pyramidCameraMatrixUniform,
+                    _pyramidProjectionMatrixUniform,
+                    _pyramidNearUniform,
+                    _pyramidSizeUniform;
+        };
+
+        CullingShader _shader;
+        GL::Buffer _objects, _commands;
+        std::size_t _objectCount;
+};
+
+}}
+
+#endif
@@ -28,10 +28,23 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#ifdef OBJECT_TRANSFORMATIONS
+layout(std430, binding = 0) readonly buffer Transformations {
+    highp mat4 transformations[];
+};
+#endif
+
 uniform highp mat4 transformationMatrix;
 
 in highp vec4 position;
+#ifdef OBJECT_TRANSFORMATIONS
+in highp uint objectIndex;
+#endif
 
 void main() {
+    #ifdef OBJECT_TRANSFORMATIONS
+    gl_Position = transformationMatrix*transformations[objectIndex]*position;
+    #else
     gl_Position = transformationMatrix * position;
+    #endif
 }
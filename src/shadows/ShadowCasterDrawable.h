@@ -48,18 +48,36 @@ class ShadowCasterDrawable: public SceneGraph::Drawable3D {
             _radius = radius;
         }
 
+        /**
+         * @brief Range of the mesh in a shared vertex and index buffer
+         *
+         * Used by @ref ShadowLight::renderBatched() to build the draw
+         * commands, not needed for @ref draw().
+         */
+        void setMeshRange(UnsignedInt indexOffset, UnsignedInt indexCount, Int baseVertex) {
+            _indexOffset = indexOffset;
+            _indexCount = indexCount;
+            _baseVertex = baseVertex;
+        }
+
         void setShader(ShadowCasterShader& shader) {
             _shader = &shader;
         }
 
         Float radius() const { return _radius; }
 
+        UnsignedInt indexOffset() const { return _indexOffset; }
+        UnsignedInt indexCount() const { return _indexCount; }
+        Int baseVertex() const { return _baseVertex; }
+
         void draw(const Matrix4& transformationMatrix, SceneGraph::Camera3D& shadowCamera) override;
 
     private:
         GL::Mesh* _mesh{};
         ShadowCasterShader* _shader{};
         Float _radius;
+        UnsignedInt _indexOffset{}, _indexCount{};
+        Int _baseVertex{};
 };
 
 }}
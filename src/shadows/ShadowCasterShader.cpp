@@ -39,19 +39,27 @@
 
 namespace Magnum { namespace Examples {
 
-ShadowCasterShader::ShadowCasterShader() {
-    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL330);
+ShadowCasterShader::ShadowCasterShader(const Flags flags): _flags{flags} {
+    const GL::Version version = flags & Flag::ObjectTransformations ?
+        GL::Version::GL430 : GL::Version::GL330;
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(version);
 
     const Utility::Resource rs{"shadow-data"};
 
-    GL::Shader vert{GL::Version::GL330, GL::Shader::Type::Vertex};
-    GL::Shader frag{GL::Version::GL330, GL::Shader::Type::Fragment};
+    GL::Shader vert{version, GL::Shader::Type::Vertex};
+    GL::Shader frag{version, GL::Shader::Type::Fragment};
 
+    if(flags & Flag::ObjectTransformations)
+        vert.addSource("#define OBJECT_TRANSFORMATIONS\n");
     vert.addSource(rs.get("ShadowCaster.vert"));
     frag.addSource(rs.get("ShadowCaster.frag"));
 
     CORRADE_INTERNAL_ASSERT_OUTPUT(GL::Shader::compile({vert, frag}));
 
+    bindAttributeLocation(Position::Location, "position");
+    if(flags & Flag::ObjectTransformations)
+        bindAttributeLocation(ObjectIndex::Location, "objectIndex");
+
     attachShaders({vert, frag});
 
     CORRADE_INTERNAL_ASSERT_OUTPUT(link());
@@ -30,27 +30,66 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/EnumSet.h>
 #include <Magnum/GL/AbstractShaderProgram.h>
+#include <Magnum/Shaders/Generic.h>
 
 namespace Magnum { namespace Examples {
 
 class ShadowCasterShader: public GL::AbstractShaderProgram {
     public:
-        explicit ShadowCasterShader();
+        typedef Shaders::Generic3D::Position Position;
+
+        /**
+         * @brief Object index
+         *
+         * Used only with @ref Flag::ObjectTransformations, same as
+         * @ref ShadowReceiverShader::ObjectIndex.
+         */
+        typedef GL::Attribute<4, UnsignedInt> ObjectIndex;
+
+        enum: UnsignedInt {
+            /** Shader storage buffer binding for object transformations */
+            TransformationBufferBinding = 0
+        };
+
+        enum class Flag: UnsignedByte {
+            /**
+             * Take model matrices from a shader storage buffer bound to
+             * @ref TransformationBufferBinding and indexed by
+             * @ref ObjectIndex. The matrix passed to
+             * @ref setTransformationMatrix() is then only the
+             * view-projection part. Requires OpenGL 4.3.
+             */
+            ObjectTransformations = 1 << 0
+        };
+
+        typedef Containers::EnumSet<Flag> Flags;
+
+        explicit ShadowCasterShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
+
+        explicit ShadowCasterShader(Flags flags = {});
+
+        Flags flags() const { return _flags; }
 
         /**
          * @brief Set transformation matrix
          *
          * Matrix that transforms from local model space -> world space ->
          * camera space -> clip coordinates (aka model-view-projection
-         * matrix).
+         * matrix). With @ref Flag::ObjectTransformations the model part is
+         * taken from the storage buffer and this is just world space ->
+         * clip coordinates.
          */
         ShadowCasterShader& setTransformationMatrix(const Matrix4& matrix);
 
     private:
+        Flags _flags;
         Int _transformationMatrixUniform;
 };
 
+CORRADE_ENUMSET_OPERATORS(ShadowCasterShader::Flags)
+
 }}
 
 #endif
@@ -31,6 +31,8 @@
 #include "ShadowLight.h"
 
 #include <algorithm>
+#include <cstring>
+#include <limits>
 #include <Magnum/ImageView.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
 #include <Magnum/GL/PixelFormat.h>
@@ -40,11 +42,14 @@
 #include <Magnum/SceneGraph/MatrixTransformation3D.h>
 #include <Magnum/SceneGraph/Scene.h>
 
+#include "MultiDrawIndirect.h"
+#include "TaskPool.h"
 #include "ShadowCasterDrawable.h"
+#include "ShadowCasterShader.h"
 
 namespace Magnum { namespace Examples {
 
-ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate} {
+ShadowLight::ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent): SceneGraph::Camera3D{parent}, _object(parent), _shadowTexture{NoCreate}, _casterCommands{256*sizeof(DrawCommand)} {
     setAspectRatioPolicy(SceneGraph::AspectRatioPolicy::NotPreserved);
 }
 
@@ -72,12 +77,18 @@ void ShadowLight::setupShadowmaps(Int numShadowLevels, const Vector2i& size) {
 ShadowLight::ShadowLayerData::ShadowLayerData(const Vector2i& size): shadowFramebuffer{{{}, size}} {}
 
 void ShadowLight::setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera) {
-    Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, screenDirection);
+    const Matrix4 cameraMatrix = Matrix4::lookAt({}, -lightDirection, screenDirection);
     const Matrix3x3 cameraRotationMatrix = cameraMatrix.rotation();
     const Matrix3x3 inverseCameraRotationMatrix = cameraRotationMatrix.inverted();
 
-    for(std::size_t layerIndex = 0; layerIndex != _layers.size(); ++layerIndex) {
-        std::vector<Vector3> mainCameraFrustumCorners = layerFrustumCorners(mainCamera, Int(layerIndex));
+    /* The main camera matrices are calculated lazily, query them before
+       going parallel */
+    const Matrix4 imvp = (mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted();
+
+    /* Each layer is independent, fit them in parallel */
+    forEach(_layers.size(), [&](const std::size_t layerIndex) {
+        Vector3 mainCameraFrustumCorners[8];
+        layerFrustumCorners(imvp, Int(layerIndex), mainCameraFrustumCorners);
         ShadowLayerData& layer = _layers[layerIndex];
 
         /* Calculate the AABB in shadow-camera space */
@@ -98,9 +109,10 @@ void ShadowLight::setTarget(const Vector3& lightDirection, const Vector3& screen
         layer.orthographicSize = range.xy();
         layer.orthographicNear = -0.5f*range.z();
         layer.orthographicFar =  0.5f*range.z();
-        cameraMatrix.translation() = cameraPosition;
-        layer.shadowCameraMatrix = cameraMatrix;
-    }
+        Matrix4 shadowCameraMatrix = cameraMatrix;
+        shadowCameraMatrix.translation() = cameraPosition;
+        layer.shadowCameraMatrix = shadowCameraMatrix;
+    });
 }
 
 Float ShadowLight::cutZ(const Int layer) const {
@@ -122,30 +134,37 @@ Float ShadowLight::cutDistance(const Float zNear, const Float zFar, const Int la
     return zLinear;
 }
 
-std::vector<Vector3> ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer) {
+void ShadowLight::layerFrustumCorners(SceneGraph::Camera3D& mainCamera, const Int layer, Vector3(&corners)[8]) {
+    layerFrustumCorners((mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted(), layer, corners);
+}
+
+void ShadowLight::layerFrustumCorners(const Matrix4& imvp, const Int layer, Vector3(&corners)[8]) const {
     const Float z0 = layer == 0 ? 0 : _layers[layer - 1].cutPlane;
     const Float z1 = _layers[layer].cutPlane;
-    return cameraFrustumCorners(mainCamera, z0, z1);
+    frustumCorners(imvp, z0, z1, corners);
 }
 
-std::vector<Vector3> ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1) {
+void ShadowLight::cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, const Float z0, const Float z1, Vector3(&corners)[8]) {
     const Matrix4 imvp = (mainCamera.projectionMatrix()*mainCamera.cameraMatrix()).inverted();
-    return frustumCorners(imvp, z0, z1);
+    frustumCorners(imvp, z0, z1, corners);
 }
 
-std::vector<Vector3> ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1) {
-    return {imvp.transformPoint({-1,-1, z0}),
-            imvp.transformPoint({ 1,-1, z0}),
-            imvp.transformPoint({-1, 1, z0}),
-            imvp.transformPoint({ 1, 1, z0}),
-            imvp.transformPoint({-1,-1, z1}),
-            imvp.transformPoint({ 1,-1, z1}),
-            imvp.transformPoint({-1, 1, z1}),
-            imvp.transformPoint({ 1, 1, z1})};
+void ShadowLight::frustumCorners(const Matrix4& imvp, const Float z0, const Float z1, Vector3(&corners)[8]) {
+    corners[0] = imvp.transformPoint({-1,-1, z0});
+    corners[1] = imvp.transformPoint({ 1,-1, z0});
+    corners[2] = imvp.transformPoint({-1, 1, z0});
+    corners[3] = imvp.transformPoint({ 1, 1, z0});
+    corners[4] = imvp.transformPoint({-1,-1, z1});
+    corners[5] = imvp.transformPoint({ 1,-1, z1});
+    corners[6] = imvp.transformPoint({-1, 1, z1});
+    corners[7] = imvp.transformPoint({ 1, 1, z1});
 }
 
 std::vector<Vector4> ShadowLight::calculateClipPlanes() {
-    const Matrix4 pm = projectionMatrix();
+    return calculateClipPlanes(projectionMatrix());
+}
+
+std::vector<Vector4> ShadowLight::calculateClipPlanes(const Matrix4& pm) {
     std::vector<Vector4> clipPlanes{
         {pm[3][0] + pm[2][0], pm[3][1] + pm[2][1], pm[3][2] + pm[2][2], pm[3][3] + pm[2][3]},   /* near */
         {pm[3][0] - pm[2][0], pm[3][1] - pm[2][1], pm[3][2] - pm[2][2], pm[3][3] - pm[2][3]},   /* far */
@@ -158,86 +177,145 @@ std::vector<Vector4> ShadowLight::calculateClipPlanes() {
     return clipPlanes;
 }
 
-void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables) {
-    /* Compute transformations of all objects in the group relative to the camera */
-    std::vector<std::reference_wrapper<Object3D>> objects;
-    objects.reserve(drawables.size());
-    for(std::size_t i = 0; i != drawables.size(); ++i)
-        objects.push_back(static_cast<Object3D&>(drawables[i].object()));
-    std::vector<ShadowCasterDrawable*> filteredDrawables;
-
+namespace {
     /* Projecting world points normalized device coordinates means they range
        -1 -> 1. Use this bias matrix so we go straight from world -> texture
        space */
-    constexpr const Matrix4 bias{{0.5f, 0.0f, 0.0f, 0.0f},
-                                 {0.0f, 0.5f, 0.0f, 0.0f},
-                                 {0.0f, 0.0f, 0.5f, 0.0f},
-                                 {0.5f, 0.5f, 0.5f, 1.0f}};
+    constexpr const Matrix4 ShadowBias{{0.5f, 0.0f, 0.0f, 0.0f},
+                                       {0.0f, 0.5f, 0.0f, 0.0f},
+                                       {0.0f, 0.0f, 0.5f, 0.0f},
+                                       {0.5f, 0.5f, 0.5f, 1.0f}};
+}
+
+void ShadowLight::forEach(const std::size_t count, const std::function<void(std::size_t)>& task) {
+    if(_taskPool) _taskPool->run(count, task);
+    else for(std::size_t i = 0; i != count; ++i) task(i);
+}
+
+bool ShadowLight::clipCaster(const std::vector<Vector4>& clipPlanes, const Vector4& drawableCentre, const Float radius, Float& orthographicNear) {
+    /* Start at 1, not 0 to skip out the near plane because we need to include
+       shadow casters traveling the direction the camera is facing. */
+    for(std::size_t clipPlaneIndex = 1; clipPlaneIndex != clipPlanes.size(); ++clipPlaneIndex) {
+        const Float distance = Math::dot(clipPlanes[clipPlaneIndex], drawableCentre);
+
+        /* If the object is on the useless side of any one plane, we can skip it */
+        if(distance < -radius) return false;
+    }
+
+    /* If this object extends in front of the near plane, extend the near
+       plane. We negate the z because the negative z is forward away from the
+       camera, but the near/far planes are measured forwards. */
+    const Float nearestPoint = -drawableCentre.z() - radius;
+    orthographicNear = Math::min(orthographicNear, nearestPoint);
+    return true;
+}
+
+void ShadowLight::clipCasters(SceneGraph::DrawableGroup3D& drawables) {
+    /* World transformations of all casters. Calculating the absolute
+       transformation only reads the hierarchy, so it can be done in parallel
+       as long as nothing modifies the scene meanwhile. Split into chunks,
+       one task per object would be too fine-grained. */
+    _casterTransformations.resize(drawables.size());
+    constexpr std::size_t ChunkSize = 4096;
+    forEach((drawables.size() + ChunkSize - 1)/ChunkSize, [&](const std::size_t chunk) {
+        const std::size_t end = std::min(drawables.size(), (chunk + 1)*ChunkSize);
+        for(std::size_t i = chunk*ChunkSize; i != end; ++i)
+            _casterTransformations[i] = drawables[i].object().absoluteTransformationMatrix();
+    });
+
+    /* Clip the casters with each layer's planes, one task per layer. Nothing
+       here touches the camera itself, so the tasks are independent. */
+    forEach(_layers.size(), [&](const std::size_t layer) {
+        ShadowLayerData& d = _layers[layer];
+        const Matrix4 shadowCameraMatrix = d.shadowCameraMatrix.invertedRigid();
+        const std::vector<Vector4> clipPlanes = calculateClipPlanes(
+            Matrix4::orthographicProjection(d.orthographicSize, d.orthographicNear, d.orthographicFar));
+
+        d.casterNear = d.orthographicNear;
+        d.casters.clear();
+        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
+            const auto& drawable = static_cast<const ShadowCasterDrawable&>(drawables[drawableIndex]);
+
+            /* If your centre is offset, inject it here */
+            const Vector4 drawableCentre = shadowCameraMatrix*Vector4{_casterTransformations[drawableIndex].translation(), 1.0f};
+
+            if(clipCaster(clipPlanes, drawableCentre, drawable.radius(), d.casterNear))
+                d.casters.push_back(UnsignedInt(drawableIndex));
+        }
+    });
+}
+
+void ShadowLight::setupLayer(ShadowLayerData& d) {
+    /* Move this whole object to the right place to render each layer */
+    _object.setTransformation(d.shadowCameraMatrix)
+        .setClean();
+
+    /* Calculate the projection matrix with near plane extended by
+       clipCasters() */
+    const Matrix4 shadowCameraProjectionMatrix =
+        Matrix4::orthographicProjection(d.orthographicSize, d.casterNear, d.orthographicFar);
+    d.shadowMatrix = ShadowBias*shadowCameraProjectionMatrix*cameraMatrix();
+    setProjectionMatrix(shadowCameraProjectionMatrix);
+
+    d.shadowFramebuffer.clear(GL::FramebufferClear::Depth)
+        .bind();
+}
+
+void ShadowLight::render(SceneGraph::DrawableGroup3D& drawables) {
+    clipCasters(drawables);
 
     GL::Renderer::setDepthMask(true);
 
     for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
         ShadowLayerData& d = _layers[layer];
-        Float orthographicNear = d.orthographicNear;
-        const Float orthographicFar = d.orthographicFar;
+        setupLayer(d);
 
-        /* Move this whole object to the right place to render each layer */
-        _object.setTransformation(d.shadowCameraMatrix)
-            .setClean();
-        setProjectionMatrix(Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar));
+        const Matrix4 shadowCameraMatrix = cameraMatrix();
+        for(const UnsignedInt drawableIndex: d.casters)
+            static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]).draw(
+                shadowCameraMatrix*_casterTransformations[drawableIndex], *this);
+    }
 
-        const std::vector<Vector4> clipPlanes = calculateClipPlanes();
-        std::vector<Matrix4> transformations = _object.scene()->transformationMatrices(objects, cameraMatrix());
+    GL::defaultFramebuffer.bind();
+}
 
-        /* Rebuild the list of objects we will draw by clipping them with the
-           shadow camera's planes */
-        std::size_t transformationsOutIndex = 0;
-        filteredDrawables.clear();
-        for(std::size_t drawableIndex = 0; drawableIndex != drawables.size(); ++drawableIndex) {
-            auto& drawable = static_cast<ShadowCasterDrawable&>(drawables[drawableIndex]);
-            const Matrix4 transform = transformations[drawableIndex];
+void ShadowLight::renderBatched(SceneGraph::DrawableGroup3D& drawables, GL::Mesh& mesh, ShadowCasterShader& shader) {
+    clipCasters(drawables);
 
-            /* If your centre is offset, inject it here */
-            const Vector4 localCentre{0.0f, 0.0f, 0.0f, 1.0f};
-            const Vector4 drawableCentre = transform*localCentre;
-
-            /* Start at 1, not 0 to skip out the near plane because we need to
-               include shadow casters traveling the direction the camera is
-               facing. */
-            for(std::size_t clipPlaneIndex = 1; clipPlaneIndex != clipPlanes.size(); ++clipPlaneIndex) {
-                const Float distance = Math::dot(clipPlanes[clipPlaneIndex], drawableCentre);
-
-                /* If the object is on the useless side of any one plane, we can skip it */
-                if(distance < -drawable.radius())
-                    goto next;
-            }
+    /* World transformations are shared by all layers, the shader picks them
+       by the base instance. The scene is mostly static, so upload them only
+       if anything changed since the last time. */
+    if(_uploadedCasterTransformations.size() != _casterTransformations.size() || std::memcmp(_uploadedCasterTransformations.data(), _casterTransformations.data(), _casterTransformations.size()*sizeof(Matrix4)) != 0) {
+        _casterTransformationBuffer.setData(_casterTransformations, GL::BufferUsage::StaticDraw);
+        _uploadedCasterTransformations = _casterTransformations;
+    }
+    _casterTransformationBuffer.bind(GL::Buffer::Target::ShaderStorage, ShadowCasterShader::TransformationBufferBinding);
 
-            {
-                /* If this object extends in front of the near plane, extend
-                   the near plane. We negate the z because the negative z is
-                   forward away from the camera, but the near/far planes are
-                   measured forwards. */
-                const Float nearestPoint = -drawableCentre.z() - drawable.radius();
-                orthographicNear = Math::min(orthographicNear, nearestPoint);
-                filteredDrawables.push_back(&drawable);
-                transformations[transformationsOutIndex++] = transform;
-            }
+    _casterCommands.begin();
+    GL::Renderer::setDepthMask(true);
 
-            next:;
-        }
+    for(std::size_t layer = 0; layer != _layers.size(); ++layer) {
+        ShadowLayerData& d = _layers[layer];
 
-        /* Recalculate the projection matrix with new near plane. */
-        const Matrix4 shadowCameraProjectionMatrix =
-            Matrix4::orthographicProjection(d.orthographicSize, orthographicNear, orthographicFar);
-        d.shadowMatrix = bias*shadowCameraProjectionMatrix*cameraMatrix();
-        setProjectionMatrix(shadowCameraProjectionMatrix);
+        /* Commands of all layers go into the same streaming buffer region,
+           remember where this layer's start. The buffer might get
+           reallocated by allocate(), so query the region offset only after. */
+        const std::size_t commandOffset = _casterCommands.size();
+        if(!d.casters.empty()) {
+            Containers::ArrayView<DrawCommand> commands = Containers::arrayCast<DrawCommand>(_casterCommands.allocate(d.casters.size()*sizeof(DrawCommand)));
+            for(std::size_t i = 0; i != d.casters.size(); ++i) {
+                const auto& drawable = static_cast<const ShadowCasterDrawable&>(drawables[d.casters[i]]);
+                commands[i] = {drawable.indexCount(), 1, drawable.indexOffset(), drawable.baseVertex(), d.casters[i]};
+            }
+            _casterCommands.flush();
+        }
 
-        d.shadowFramebuffer.clear(GL::FramebufferClear::Depth)
-            .bind();
-        for(std::size_t i = 0; i != transformationsOutIndex; ++i)
-            filteredDrawables[i]->draw(transformations[i], *this);
+        setupLayer(d);
+        shader.setTransformationMatrix(projectionMatrix()*cameraMatrix());
+        multiDrawIndirect(mesh, shader, _casterCommands.buffer(), _casterCommands.regionOffset() + commandOffset, d.casters.size());
     }
 
+    _casterCommands.fence();
     GL::defaultFramebuffer.bind();
 }
 
@@ -30,17 +30,25 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <functional>
+#include <vector>
 #include <Magnum/Resource.h>
+#include <Magnum/GL/Buffer.h>
 #include <Magnum/GL/Framebuffer.h>
 #include <Magnum/GL/TextureArray.h>
 #include <Magnum/SceneGraph/Camera.h>
 #include <Magnum/SceneGraph/Drawable.h>
 #include <Magnum/SceneGraph/AbstractFeature.h>
 
+#include "MultiDrawIndirect.h"
+#include "StreamingBuffer.h"
 #include "Types.h"
 
 namespace Magnum { namespace Examples {
 
+class ShadowCasterShader;
+class TaskPool;
+
 /**
 @brief A special camera used to render shadow maps
 
@@ -48,12 +56,32 @@ The object it's attached to should face the direction that the light travels.
 */
 class ShadowLight: public SceneGraph::Camera3D {
     public:
-        static std::vector<Vector3> cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0 = -1.0f, Float z1 = 1.0f);
+        static void cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Float z0, Float z1, Vector3(&corners)[8]);
 
-        static std::vector<Vector3> frustumCorners(const Matrix4& imvp, Float z0, Float z1);
+        /** @brief Calculate world-space corners of the whole camera frustum */
+        static void cameraFrustumCorners(SceneGraph::Camera3D& mainCamera, Vector3(&corners)[8]) {
+            cameraFrustumCorners(mainCamera, -1.0f, 1.0f, corners);
+        }
+
+        /**
+         * @brief Calculate world-space corners of a frustum
+         *
+         * Near plane corners go first, then the far plane ones, each in the
+         * bottom left, bottom right, top left, top right order.
+         */
+        static void frustumCorners(const Matrix4& imvp, Float z0, Float z1, Vector3(&corners)[8]);
 
         explicit ShadowLight(SceneGraph::Object<SceneGraph::MatrixTransformation3D>& parent);
 
+        /**
+         * @brief Set a task pool for cascade fitting and caster clipping
+         *
+         * If set, @ref setTarget() fits each layer and @ref clipCasters()
+         * clips casters for each layer in a separate task. If
+         * @cpp nullptr @ce, everything is done on the calling thread.
+         */
+        void setTaskPool(TaskPool* pool) { _taskPool = pool; }
+
         /**
          * @brief Initialize the shadow map texture array and framebuffers
          *
@@ -80,16 +108,62 @@ class ShadowLight: public SceneGraph::Camera3D {
          *      splits (normally, the main camera that the shadows will be
          *      rendered to)
          *
-         * Should be called whenever your camera moves.
+         * Should be called whenever your camera moves. Layers are fitted in
+         * parallel if @ref setTaskPool() is set.
          */
         void setTarget(const Vector3& lightDirection, const Vector3& screenDirection, SceneGraph::Camera3D& mainCamera);
 
+        /**
+         * @brief Clip shadow casters against all layers
+         *
+         * Calculates world transformations of all drawables and in one task
+         * per layer finds the ones that cast a shadow into the layer,
+         * extending the layer's near plane to include them. Called from
+         * @ref render() and @ref renderBatched(), exposed separately to be
+         * able to measure the CPU part alone. The scene shouldn't be
+         * modified while this function runs.
+         */
+        void clipCasters(SceneGraph::DrawableGroup3D& drawables);
+
+        /**
+         * @brief Count of casters found in given layer
+         *
+         * Valid after @ref clipCasters() was called.
+         */
+        std::size_t layerCasterCount(Int layer) const {
+            return _layers[layer].casters.size();
+        }
+
         /**
          * @brief Render a group of shadow-casting drawables to the shadow maps
          */
         void render(SceneGraph::DrawableGroup3D& drawables);
 
-        std::vector<Vector3> layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer);
+        /**
+         * @brief Render shadow casters with one draw call per layer
+         *
+         * Does the same clipping as @ref render(), but instead of drawing
+         * each @ref ShadowCasterDrawable separately, a list of draw commands
+         * is built for each layer and submitted with a single
+         * @ref multiDrawIndirect() call. All drawables are expected to have
+         * @ref ShadowCasterDrawable::setMeshRange() set to a range of
+         * @p mesh, which has to have a @ref ShadowCasterShader::ObjectIndex
+         * attribute with consecutive numbers and a divisor of 1. The
+         * @p shader is expected to be created with
+         * @ref ShadowCasterShader::Flag::ObjectTransformations. Requires
+         * OpenGL 4.3.
+         */
+        void renderBatched(SceneGraph::DrawableGroup3D& drawables, GL::Mesh& mesh, ShadowCasterShader& shader);
+
+        void layerFrustumCorners(SceneGraph::Camera3D& mainCamera, Int layer, Vector3(&corners)[8]);
+
+        /**
+         * @brief Calculate world-space corners of a layer frustum
+         *
+         * Same as above, but taking the inverted view-projection matrix of
+         * the main camera.
+         */
+        void layerFrustumCorners(const Matrix4& imvp, Int layer, Vector3(&corners)[8]) const;
 
         Float cutZ(Int layer) const;
 
@@ -103,9 +177,18 @@ class ShadowLight: public SceneGraph::Camera3D {
 
         std::vector<Vector4> calculateClipPlanes();
 
+        /** @brief Calculate normalized clip planes of given projection */
+        static std::vector<Vector4> calculateClipPlanes(const Matrix4& projectionMatrix);
+
         GL::Texture2DArray& shadowTexture() { return _shadowTexture; }
 
     private:
+        struct ShadowLayerData;
+
+        void forEach(std::size_t count, const std::function<void(std::size_t)>& task);
+        static bool clipCaster(const std::vector<Vector4>& clipPlanes, const Vector4& drawableCentre, Float radius, Float& orthographicNear);
+        void setupLayer(ShadowLayerData& d);
+
         Object3D& _object;
         GL::Texture2DArray _shadowTexture;
 
@@ -117,10 +200,22 @@ class ShadowLight: public SceneGraph::Camera3D {
             Float orthographicNear, orthographicFar;
             Float cutPlane;
 
+            /* Filled by clipCasters() */
+            std::vector<UnsignedInt> casters;
+            Float casterNear;
+
             explicit ShadowLayerData(const Vector2i& size);
         };
 
         std::vector<ShadowLayerData> _layers;
+
+        TaskPool* _taskPool{};
+        std::vector<Matrix4> _casterTransformations;
+
+        /* Used by renderBatched() only */
+        std::vector<Matrix4> _uploadedCasterTransformations;
+        GL::Buffer _casterTransformationBuffer;
+        StreamingBuffer _casterCommands;
 };
 
 }}
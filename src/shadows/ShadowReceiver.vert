@@ -28,18 +28,33 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#ifdef OBJECT_TRANSFORMATIONS
+layout(std430, binding = 0) readonly buffer Transformations {
+    highp mat4 transformations[];
+};
+
+uniform highp mat4 viewProjectionMatrix;
+#else
 uniform highp mat4 modelMatrix;
 uniform highp mat4 transformationProjectionMatrix;
+#endif
 uniform highp mat4 shadowmapMatrix[NUM_SHADOW_MAP_LEVELS];
 
 in highp vec4 position;
 in mediump vec3 normal;
+#ifdef OBJECT_TRANSFORMATIONS
+in highp uint objectIndex;
+#endif
 
 out mediump vec3 transformedNormal;
 
 out highp vec3 shadowCoords[NUM_SHADOW_MAP_LEVELS];
 
 void main() {
+    #ifdef OBJECT_TRANSFORMATIONS
+    highp mat4 modelMatrix = transformations[objectIndex];
+    #endif
+
     transformedNormal = mat3(modelMatrix)*normal;
 
     vec4 worldPos4 = modelMatrix * position;
@@ -47,5 +62,9 @@ void main() {
         shadowCoords[i] = (shadowmapMatrix[i]*worldPos4).xyz;
     }
 
+    #ifdef OBJECT_TRANSFORMATIONS
+    gl_Position = viewProjectionMatrix*worldPos4;
+    #else
     gl_Position = transformationProjectionMatrix*position;
+    #endif
 }
@@ -40,15 +40,19 @@
 
 namespace Magnum { namespace Examples {
 
-ShadowReceiverShader::ShadowReceiverShader(std::size_t numShadowLevels) {
-    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(GL::Version::GL330);
+ShadowReceiverShader::ShadowReceiverShader(std::size_t numShadowLevels, const Flags flags): _flags{flags} {
+    const GL::Version version = flags & Flag::ObjectTransformations ?
+        GL::Version::GL430 : GL::Version::GL330;
+    MAGNUM_ASSERT_GL_VERSION_SUPPORTED(version);
 
     const Utility::Resource rs{"shadow-data"};
 
-    GL::Shader vert{GL::Version::GL330, GL::Shader::Type::Vertex};
-    GL::Shader frag{GL::Version::GL330, GL::Shader::Type::Fragment};
+    GL::Shader vert{version, GL::Shader::Type::Vertex};
+    GL::Shader frag{version, GL::Shader::Type::Fragment};
 
     std::string preamble = "#define NUM_SHADOW_MAP_LEVELS " + std::to_string(numShadowLevels) + "\n";
+    if(flags & Flag::ObjectTransformations)
+        preamble += "#define OBJECT_TRANSFORMATIONS\n";
     vert.addSource(preamble);
     vert.addSource(rs.get("ShadowReceiver.vert"));
     frag.addSource(preamble);
@@ -58,13 +62,19 @@ ShadowReceiverShader::ShadowReceiverShader(std::size_t numShadowLevels) {
 
     bindAttributeLocation(Position::Location, "position");
     bindAttributeLocation(Normal::Location, "normal");
+    if(flags & Flag::ObjectTransformations)
+        bindAttributeLocation(ObjectIndex::Location, "objectIndex");
 
     attachShaders({vert, frag});
 
     CORRADE_INTERNAL_ASSERT_OUTPUT(link());
 
-    _modelMatrixUniform = uniformLocation("modelMatrix");
-    _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+    if(flags & Flag::ObjectTransformations) {
+        _viewProjectionMatrixUniform = uniformLocation("viewProjectionMatrix");
+    } else {
+        _modelMatrixUniform = uniformLocation("modelMatrix");
+        _transformationProjectionMatrixUniform = uniformLocation("transformationProjectionMatrix");
+    }
     _shadowmapMatrixUniform = uniformLocation("shadowmapMatrix");
     _lightDirectionUniform = uniformLocation("lightDirection");
     _shadowBiasUniform = uniformLocation("shadowBias");
@@ -82,6 +92,11 @@ ShadowReceiverShader& ShadowReceiverShader::setModelMatrix(const Matrix4& matrix
     return *this;
 }
 
+ShadowReceiverShader& ShadowReceiverShader::setViewProjectionMatrix(const Matrix4& matrix) {
+    setUniform(_viewProjectionMatrixUniform, matrix);
+    return *this;
+}
+
 ShadowReceiverShader& ShadowReceiverShader::setShadowmapMatrices(const Containers::ArrayView<const Matrix4> matrices) {
     setUniform(_shadowmapMatrixUniform, matrices);
     return *this;
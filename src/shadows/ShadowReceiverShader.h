@@ -30,6 +30,7 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <Corrade/Containers/EnumSet.h>
 #include <Magnum/GL/AbstractShaderProgram.h>
 #include <Magnum/Shaders/Generic.h>
 
@@ -41,9 +42,39 @@ class ShadowReceiverShader: public GL::AbstractShaderProgram {
         typedef Shaders::Generic3D::Position Position;
         typedef Shaders::Generic3D::Normal Normal;
 
+        /**
+         * @brief Object index
+         *
+         * Used only with @ref Flag::ObjectTransformations, expected to be an
+         * instanced attribute with consecutive numbers so draws can select
+         * the object using base instance.
+         */
+        typedef GL::Attribute<4, UnsignedInt> ObjectIndex;
+
+        enum: UnsignedInt {
+            /** Shader storage buffer binding for object transformations */
+            TransformationBufferBinding = 0
+        };
+
+        enum class Flag: UnsignedByte {
+            /**
+             * Take model matrices from a shader storage buffer bound to
+             * @ref TransformationBufferBinding and indexed by
+             * @ref ObjectIndex instead of uniforms. Use
+             * @ref setViewProjectionMatrix() instead of
+             * @ref setTransformationProjectionMatrix() and
+             * @ref setModelMatrix(). Requires OpenGL 4.3.
+             */
+            ObjectTransformations = 1 << 0
+        };
+
+        typedef Containers::EnumSet<Flag> Flags;
+
         explicit ShadowReceiverShader(NoCreateT): GL::AbstractShaderProgram{NoCreate} {}
 
-        explicit ShadowReceiverShader(std::size_t numShadowLevels);
+        explicit ShadowReceiverShader(std::size_t numShadowLevels, Flags flags = {});
+
+        Flags flags() const { return _flags; }
 
         /**
          * @brief Set transformation and projection matrix
@@ -61,6 +92,14 @@ class ShadowReceiverShader: public GL::AbstractShaderProgram {
          */
         ShadowReceiverShader& setModelMatrix(const Matrix4& matrix);
 
+        /**
+         * @brief Set view and projection matrix
+         *
+         * Matrix that transforms from world space -> camera space -> clip
+         * coordinates. Used only with @ref Flag::ObjectTransformations.
+         */
+        ShadowReceiverShader& setViewProjectionMatrix(const Matrix4& matrix);
+
         /**
          * @brief Set shadowmap matrices
          *
@@ -84,13 +123,17 @@ class ShadowReceiverShader: public GL::AbstractShaderProgram {
     private:
         enum: Int { ShadowmapTextureLayer = 0 };
 
-        Int _modelMatrixUniform,
-            _transformationProjectionMatrixUniform,
+        Flags _flags;
+        Int _modelMatrixUniform{-1},
+            _transformationProjectionMatrixUniform{-1},
+            _viewProjectionMatrixUniform{-1},
             _shadowmapMatrixUniform,
             _lightDirectionUniform,
             _shadowBiasUniform;
 };
 
+CORRADE_ENUMSET_OPERATORS(ShadowReceiverShader::Flags)
+
 }}
 
 #endif
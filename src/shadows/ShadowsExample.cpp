@@ -28,12 +28,22 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <Corrade/Containers/Pointer.h>
+#include <Corrade/Utility/Arguments.h>
 #include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Context.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
+#include <Magnum/GL/Framebuffer.h>
+#include <Magnum/GL/Renderbuffer.h>
+#include <Magnum/GL/RenderbufferFormat.h>
 #include <Magnum/GL/Renderer.h>
 #include <Magnum/GL/Texture.h>
-#include <Magnum/MeshTools/Interleave.h>
-#include <Magnum/MeshTools/CompressIndices.h>
+#include <Magnum/GL/TextureFormat.h>
+#include <Magnum/GL/Version.h>
+#include <Magnum/Math/Functions.h>
 #include <Magnum/Platform/Sdl2Application.h>
 #include <Magnum/Primitives/Cube.h>
 #include <Magnum/Primitives/Capsule.h>
@@ -47,17 +57,22 @@
 #include <Magnum/Trade/MeshData3D.h>
 
 #include "DebugLines.h"
+#include "DepthPyramid.h"
+#include "MultiDrawIndirect.h"
+#include "OcclusionCulling.h"
 #include "ShadowCasterShader.h"
 #include "ShadowReceiverShader.h"
 #include "ShadowLight.h"
 #include "ShadowCasterDrawable.h"
 #include "ShadowReceiverDrawable.h"
+#include "TaskPool.h"
 #include "Types.h"
 
 namespace Magnum { namespace Examples {
 
 constexpr const float MainCameraNear = 0.01f;
 constexpr const float MainCameraFar = 100.0f;
+constexpr const std::size_t MaxShadowLayerCount = 32;
 
 using namespace Math::Literals;
 
@@ -66,10 +81,17 @@ class ShadowsExample: public Platform::Application {
         explicit ShadowsExample(const Arguments& arguments);
 
     private:
+        struct Vertex {
+            Vector3 position;
+            Vector3 normal;
+        };
+
+        /* All models are views into the shared _vertexBuffer and
+           _indexBuffer */
         struct Model {
-            GL::Buffer indexBuffer, vertexBuffer;
             GL::Mesh mesh;
             Float radius;
+            UnsignedInt vertexOffset, indexOffset, indexCount;
         };
 
         void drawEvent() override;
@@ -79,12 +101,19 @@ class ShadowsExample: public Platform::Application {
         void keyPressEvent(KeyEvent &event) override;
         void keyReleaseEvent(KeyEvent &event) override;
 
-        void addModel(const Trade::MeshData3D& meshData3D);
+        void setupModels(Containers::ArrayView<const Trade::MeshData3D> meshes);
+        void populateScene(std::size_t objectCount);
+        void benchmarkCascades(std::size_t maxThreadCount);
+        void setupGpuDriven();
+        void drawReceiversGpu(Containers::ArrayView<const Matrix4> shadowMatrices);
         void renderDebugLines();
         Object3D* createSceneObject(Model& model, bool makeCaster, bool makeReceiver);
         void recompileReceiverShader(std::size_t numLayers);
         void setShadowMapSize(const Vector2i& shadowMapSize);
         void setShadowSplitExponent(Float power);
+        void setShadowBias(Float bias);
+
+        Containers::Pointer<TaskPool> _taskPool;
 
         Scene3D _scene;
         SceneGraph::DrawableGroup3D _shadowCasterDrawables;
@@ -104,7 +133,27 @@ class ShadowsExample: public Platform::Application {
         Object3D* _activeCameraObject;
         SceneGraph::Camera3D* _activeCamera;
 
+        GL::Buffer _vertexBuffer, _indexBuffer{GL::Buffer::TargetHint::ElementArray};
         std::vector<Model> _models;
+        std::vector<std::pair<Object3D*, const Model*>> _receivers;
+
+        /* GPU-driven rendering. Casters are drawn with one multi-draw per
+           shadow layer, receivers are rendered into an offscreen framebuffer
+           so the depth can be used for occlusion culling in the next frame.
+           Both share the same mesh, the object index selects a transformation
+           from the storage buffer. */
+        bool _gpuDrivenSupported{}, _gpuDriven{};
+        GL::Buffer _objectIndices{NoCreate}, _receiverTransformations{NoCreate};
+        GL::Mesh _batchMesh{NoCreate};
+        ShadowCasterShader _batchShadowCasterShader{NoCreate};
+        ShadowReceiverShader _gpuShadowReceiverShader{NoCreate};
+        OcclusionCulling _occlusionCulling{NoCreate};
+        DepthPyramid _depthPyramid{NoCreate};
+        bool _depthPyramidValid{};
+        Matrix4 _depthPyramidCameraMatrix, _depthPyramidProjectionMatrix;
+        GL::Framebuffer _framebuffer{NoCreate};
+        GL::Renderbuffer _color{NoCreate};
+        GL::Texture2D _depth{NoCreate};
 
         Vector3 _mainCameraVelocity;
 
@@ -129,6 +178,16 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
     _shadowMapFaceCullMode{1},
     _shadowStaticAlignment{false}
 {
+    Utility::Arguments args;
+    args.addOption("objects", "200").setHelp("objects", "count of objects in the scene")
+        .addOption("threads", "0").setHelp("threads", "thread count for scene setup and cascade fitting, 0 for all cores")
+        .addBooleanOption("benchmark").setHelp("benchmark", "measure cascade fitting and caster clipping with 1 to --threads threads")
+        .addSkippedPrefix("magnum").setHelp("engine-specific options")
+        .parse(arguments.argc, arguments.argv);
+
+    _taskPool.reset(new TaskPool{args.value<std::size_t>("threads")});
+    _shadowLight.setTaskPool(_taskPool.get());
+
     _shadowLight.setupShadowmaps(3, _shadowMapSize);
     _shadowReceiverShader = ShadowReceiverShader{_shadowLight.layerCount()};
     _shadowReceiverShader.setShadowBias(_shadowBias);
@@ -136,21 +195,17 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
     GL::Renderer::enable(GL::Renderer::Feature::DepthTest);
     GL::Renderer::enable(GL::Renderer::Feature::FaceCulling);
 
-    addModel(Primitives::cubeSolid());
-    addModel(Primitives::capsule3DSolid(1, 1, 4, 1.0f));
-    addModel(Primitives::capsule3DSolid(6, 1, 9, 1.0f));
+    {
+        const Trade::MeshData3D meshes[]{
+            Primitives::cubeSolid(),
+            Primitives::capsule3DSolid(1, 1, 4, 1.0f),
+            Primitives::capsule3DSolid(6, 1, 9, 1.0f)};
+        setupModels(meshes);
+    }
 
-    Object3D* ground = createSceneObject(_models[0], false, true);
-    ground->setTransformation(Matrix4::scaling({100,1,100}));
+    populateScene(args.value<std::size_t>("objects"));
 
-    for(std::size_t i = 0; i != 200; ++i) {
-        Model& model = _models[std::rand()%_models.size()];
-        Object3D* object = createSceneObject(model, true, true);
-        object->setTransformation(Matrix4::translation({
-            std::rand()*100.0f/RAND_MAX - 50.0f,
-            std::rand()*5.0f/RAND_MAX,
-            std::rand()*100.0f/RAND_MAX - 50.0f}));
-    }
+    setupGpuDriven();
 
     _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
 
@@ -170,6 +225,70 @@ ShadowsExample::ShadowsExample(const Arguments& arguments):
 
     _shadowLightObject.setTransformation(Matrix4::lookAt(
         {3.0f, 1.0f, 2.0f}, {}, Vector3::yAxis()));
+
+    if(args.isSet("benchmark"))
+        benchmarkCascades(_taskPool->threadCount());
+}
+
+void ShadowsExample::populateScene(const std::size_t objectCount) {
+    Object3D* ground = createSceneObject(_models[0], false, true);
+    ground->setTransformation(Matrix4::scaling({100,1,100}));
+
+    /* Generate the placements in parallel, each chunk with its own generator
+       so the result doesn't depend on the thread count. Creating the objects
+       themselves modifies the scene, so that has to be done serially. */
+    struct Placement {
+        Vector3 translation;
+        std::size_t model;
+    };
+    Containers::Array<Placement> placements{Containers::NoInit, objectCount};
+    constexpr std::size_t ChunkSize = 4096;
+    _taskPool->run((objectCount + ChunkSize - 1)/ChunkSize, [&](const std::size_t chunk) {
+        std::minstd_rand random{UnsignedInt(chunk) + 1};
+        std::uniform_real_distribution<Float> xz{-50.0f, 50.0f}, y{0.0f, 5.0f};
+        std::uniform_int_distribution<std::size_t> model{0, _models.size() - 1};
+        const std::size_t end = std::min(objectCount, (chunk + 1)*ChunkSize);
+        for(std::size_t i = chunk*ChunkSize; i != end; ++i)
+            placements[i] = {{xz(random), y(random), xz(random)}, model(random)};
+    });
+
+    _receivers.reserve(objectCount + 1);
+    for(const Placement& placement: placements) {
+        Object3D* object = createSceneObject(_models[placement.model], true, true);
+        object->setTransformation(Matrix4::translation(placement.translation));
+    }
+
+    Debug() << "Created" << objectCount << "objects";
+}
+
+void ShadowsExample::benchmarkCascades(const std::size_t maxThreadCount) {
+    const Vector3 screenDirection = _mainCameraObject.transformation()[2].xyz();
+    constexpr std::size_t Iterations = 10;
+
+    Debug() << "Cascade fitting and caster clipping," << _shadowCasterDrawables.size() << "casters," << _shadowLight.layerCount() << "layers:";
+
+    Double singleThreaded{};
+    for(std::size_t threadCount = 1; threadCount <= maxThreadCount; ++threadCount) {
+        TaskPool pool{threadCount};
+        _shadowLight.setTaskPool(&pool);
+
+        /* Warm up so the caster lists are already allocated */
+        _shadowLight.setTarget({3, 2, 3}, screenDirection, _mainCamera);
+        _shadowLight.clipCasters(_shadowCasterDrawables);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(std::size_t i = 0; i != Iterations; ++i) {
+            _shadowLight.setTarget({3, 2, 3}, screenDirection, _mainCamera);
+            _shadowLight.clipCasters(_shadowCasterDrawables);
+        }
+        const Double milliseconds = std::chrono::duration<Double, std::milli>(
+            std::chrono::high_resolution_clock::now() - start).count()/Iterations;
+        if(threadCount == 1) singleThreaded = milliseconds;
+
+        Debug() << "   " << threadCount << "threads:" << milliseconds << "ms, speedup" << singleThreaded/milliseconds;
+    }
+
+    _shadowLight.setTaskPool(_taskPool.get());
 }
 
 Object3D* ShadowsExample::createSceneObject(Model& model, bool makeCaster, bool makeReceiver) {
@@ -179,44 +298,127 @@ Object3D* ShadowsExample::createSceneObject(Model& model, bool makeCaster, bool
         auto caster = new ShadowCasterDrawable(*object, &_shadowCasterDrawables);
         caster->setShader(_shadowCasterShader);
         caster->setMesh(model.mesh, model.radius);
+        caster->setMeshRange(model.indexOffset, model.indexCount, Int(model.vertexOffset));
     }
 
     if(makeReceiver) {
         auto receiver = new ShadowReceiverDrawable(*object, &_shadowReceiverDrawables);
         receiver->setShader(_shadowReceiverShader);
         receiver->setMesh(model.mesh);
+        _receivers.emplace_back(object, &model);
     }
 
     return object;
 }
 
-void ShadowsExample::addModel(const Trade::MeshData3D& meshData3D) {
-    _models.emplace_back();
-    Model& model = _models.back();
+void ShadowsExample::setupModels(const Containers::ArrayView<const Trade::MeshData3D> meshes) {
+    /* Pack all models into a single vertex and index buffer so the GPU-driven
+       path can draw any of them from the same mesh */
+    std::size_t vertexCount = 0, indexCount = 0;
+    for(const Trade::MeshData3D& meshData: meshes) {
+        vertexCount += meshData.positions(0).size();
+        indexCount += meshData.indices().size();
+    }
 
-    model.vertexBuffer.setData(MeshTools::interleave(meshData3D.positions(0), meshData3D.normals(0)),
-        GL::BufferUsage::StaticDraw);
+    Containers::Array<Vertex> vertices{Containers::NoInit, vertexCount};
+    Containers::Array<UnsignedInt> indices{Containers::NoInit, indexCount};
+    UnsignedInt vertexOffset = 0, indexOffset = 0;
+    _models.reserve(meshes.size());
+    for(const Trade::MeshData3D& meshData: meshes) {
+        _models.emplace_back();
+        Model& model = _models.back();
+
+        const std::vector<Vector3>& positions = meshData.positions(0);
+        const std::vector<Vector3>& normals = meshData.normals(0);
+        Float maxMagnitudeSquared = 0.0f;
+        for(std::size_t i = 0; i != positions.size(); ++i) {
+            vertices[vertexOffset + i] = {positions[i], normals[i]};
+            maxMagnitudeSquared = Math::max(maxMagnitudeSquared, positions[i].dot());
+        }
+        std::copy(meshData.indices().begin(), meshData.indices().end(),
+            indices.data() + indexOffset);
+
+        model.radius = std::sqrt(maxMagnitudeSquared);
+        model.vertexOffset = vertexOffset;
+        model.indexOffset = indexOffset;
+        model.indexCount = UnsignedInt(meshData.indices().size());
+        model.mesh.setPrimitive(meshData.primitive())
+            .setCount(model.indexCount)
+            .addVertexBuffer(_vertexBuffer, vertexOffset*sizeof(Vertex),
+                Shaders::Phong::Position{}, Shaders::Phong::Normal{})
+            .setIndexBuffer(_indexBuffer, indexOffset*sizeof(UnsignedInt),
+                MeshIndexType::UnsignedInt, 0, positions.size() - 1);
+
+        vertexOffset += UnsignedInt(positions.size());
+        indexOffset += model.indexCount;
+    }
 
-    Float maxMagnitudeSquared = 0.0f;
-    for(Vector3 position: meshData3D.positions(0)) {
-        Float magnitudeSquared = position.dot();
+    _vertexBuffer.setData(vertices, GL::BufferUsage::StaticDraw);
+    _indexBuffer.setData(indices, GL::BufferUsage::StaticDraw);
+}
 
-        if(magnitudeSquared > maxMagnitudeSquared) {
-            maxMagnitudeSquared = magnitudeSquared;
-        }
+void ShadowsExample::setupGpuDriven() {
+    _gpuDrivenSupported = GL::Context::current().isVersionSupported(GL::Version::GL430);
+    if(!_gpuDrivenSupported) {
+        Debug() << "OpenGL 4.3 not supported, GPU-driven rendering disabled";
+        return;
     }
-    model.radius = std::sqrt(maxMagnitudeSquared);
-
-    Containers::Array<char> indexData;
-    MeshIndexType indexType;
-    UnsignedInt indexStart, indexEnd;
-    std::tie(indexData, indexType, indexStart, indexEnd) = MeshTools::compressIndices(meshData3D.indices());
-    model.indexBuffer.setData(indexData, GL::BufferUsage::StaticDraw);
-
-    model.mesh.setPrimitive(meshData3D.primitive())
-        .setCount(meshData3D.indices().size())
-        .addVertexBuffer(model.vertexBuffer, 0, Shaders::Phong::Position{}, Shaders::Phong::Normal{})
-        .setIndexBuffer(model.indexBuffer, 0, indexType, indexStart, indexEnd);
+
+    _gpuDriven = true;
+
+    const Vector2i size = GL::defaultFramebuffer.viewport().size();
+    _color = GL::Renderbuffer{};
+    _color.setStorage(GL::RenderbufferFormat::RGBA8, size);
+    _depth = GL::Texture2D{};
+    _depth.setStorage(1, GL::TextureFormat::DepthComponent32F, size)
+        .setMinificationFilter(GL::SamplerFilter::Nearest)
+        .setMagnificationFilter(GL::SamplerFilter::Nearest);
+    _framebuffer = GL::Framebuffer{{{}, size}};
+    _framebuffer.attachRenderbuffer(GL::Framebuffer::ColorAttachment{0}, _color)
+        .attachTexture(GL::Framebuffer::BufferAttachment::Depth, _depth, 0);
+    CORRADE_INTERNAL_ASSERT(_framebuffer.checkStatus(GL::FramebufferTarget::Draw) == GL::Framebuffer::Status::Complete);
+
+    _depthPyramid = DepthPyramid{size};
+    _occlusionCulling = OcclusionCulling{};
+    _gpuShadowReceiverShader = ShadowReceiverShader{_shadowLight.layerCount(),
+        ShadowReceiverShader::Flag::ObjectTransformations};
+    _gpuShadowReceiverShader.setShadowBias(_shadowBias);
+    _batchShadowCasterShader = ShadowCasterShader{
+        ShadowCasterShader::Flag::ObjectTransformations};
+
+    /* The scene is static, so the transformations and bounding spheres are
+       uploaded just once. Base instance of each draw command selects the
+       object from the consecutive object indices. */
+    Containers::Array<Matrix4> transformations{Containers::NoInit, _receivers.size()};
+    Containers::Array<OcclusionCulling::Object> objects{Containers::NoInit, _receivers.size()};
+    for(std::size_t i = 0; i != _receivers.size(); ++i) {
+        const Matrix4 transformation = _receivers[i].first->absoluteTransformationMatrix();
+        const Model& model = *_receivers[i].second;
+        transformations[i] = transformation;
+        objects[i] = {{transformation.translation(), model.radius*transformation.scaling().max()},
+            model.indexCount, model.indexOffset, Int(model.vertexOffset), 0};
+    }
+
+    /* Casters use the same consecutive indices, transformations of those are
+       uploaded by ShadowLight::renderBatched() whenever they change */
+    Containers::Array<UnsignedInt> objectIndices{Containers::NoInit,
+        std::max(_receivers.size(), _shadowCasterDrawables.size())};
+    for(std::size_t i = 0; i != objectIndices.size(); ++i)
+        objectIndices[i] = UnsignedInt(i);
+
+    _occlusionCulling.setObjects(objects);
+    _receiverTransformations = GL::Buffer{};
+    _receiverTransformations.setData(transformations, GL::BufferUsage::StaticDraw);
+    _objectIndices = GL::Buffer{};
+    _objectIndices.setData(objectIndices, GL::BufferUsage::StaticDraw);
+
+    _batchMesh = GL::Mesh{};
+    _batchMesh.setPrimitive(GL::MeshPrimitive::Triangles)
+        .addVertexBuffer(_vertexBuffer, 0,
+            ShadowReceiverShader::Position{}, ShadowReceiverShader::Normal{})
+        .addVertexBufferInstanced(_objectIndices, 1, 0,
+            ShadowReceiverShader::ObjectIndex{})
+        .setIndexBuffer(_indexBuffer, 0, MeshIndexType::UnsignedInt);
 }
 
 void ShadowsExample::drawEvent() {
@@ -243,7 +445,10 @@ void ShadowsExample::drawEvent() {
     }
 
     /* Create the shadow map textures. */
-    _shadowLight.render(_shadowCasterDrawables);
+    if(_gpuDriven)
+        _shadowLight.renderBatched(_shadowCasterDrawables, _batchMesh, _batchShadowCasterShader);
+    else
+        _shadowLight.render(_shadowCasterDrawables);
 
     switch(_shadowMapFaceCullMode) {
         case 0:
@@ -261,17 +466,55 @@ void ShadowsExample::drawEvent() {
     for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex)
         shadowMatrices[layerIndex] = _shadowLight.layerMatrix(layerIndex);
 
-    _shadowReceiverShader.setShadowmapMatrices(shadowMatrices)
-        .setShadowmapTexture(_shadowLight.shadowTexture())
-        .setLightDirection(_shadowLightObject.transformation().backward());
+    if(_gpuDriven) {
+        drawReceiversGpu(shadowMatrices);
+    } else {
+        _shadowReceiverShader.setShadowmapMatrices(shadowMatrices)
+            .setShadowmapTexture(_shadowLight.shadowTexture())
+            .setLightDirection(_shadowLightObject.transformation().backward());
 
-    _activeCamera->draw(_shadowReceiverDrawables);
+        _activeCamera->draw(_shadowReceiverDrawables);
+    }
 
     renderDebugLines();
 
     swapBuffers();
 }
 
+void ShadowsExample::drawReceiversGpu(const Containers::ArrayView<const Matrix4> shadowMatrices) {
+    const Matrix4 cameraMatrix = _activeCamera->cameraMatrix();
+    const Matrix4 projectionMatrix = _activeCamera->projectionMatrix();
+
+    /* Cull against the depth of the previous frame, if there's any */
+    _occlusionCulling.cull(cameraMatrix, projectionMatrix,
+        _depthPyramidValid ? &_depthPyramid : nullptr,
+        _depthPyramidCameraMatrix, _depthPyramidProjectionMatrix);
+
+    _framebuffer.clear(GL::FramebufferClear::Color|GL::FramebufferClear::Depth)
+        .bind();
+
+    _gpuShadowReceiverShader.setViewProjectionMatrix(projectionMatrix*cameraMatrix)
+        .setShadowmapMatrices(shadowMatrices)
+        .setShadowmapTexture(_shadowLight.shadowTexture())
+        .setLightDirection(_shadowLightObject.transformation().backward());
+    _receiverTransformations.bind(GL::Buffer::Target::ShaderStorage,
+        ShadowReceiverShader::TransformationBufferBinding);
+    multiDrawIndirect(_batchMesh, _gpuShadowReceiverShader,
+        _occlusionCulling.commands(), 0, _occlusionCulling.objectCount());
+
+    /* Build the depth pyramid for the next frame */
+    _depthPyramid.build(_depth);
+    _depthPyramidValid = true;
+    _depthPyramidCameraMatrix = cameraMatrix;
+    _depthPyramidProjectionMatrix = projectionMatrix;
+
+    /* Blit color to window framebuffer */
+    GL::defaultFramebuffer.bind();
+    _framebuffer.mapForRead(GL::Framebuffer::ColorAttachment{0});
+    GL::AbstractFramebuffer::blit(_framebuffer, GL::defaultFramebuffer,
+        _framebuffer.viewport(), GL::FramebufferBlit::Color);
+}
+
 void ShadowsExample::renderDebugLines() {
     if(_activeCamera != &_debugCamera)
         return;
@@ -281,18 +524,23 @@ void ShadowsExample::renderDebugLines() {
                                          { 0.0f,  0.0f,  2.0f, 0.0f},
                                          {-1.0f, -1.0f, -1.0f, 1.0f}};
 
-    _debugLines.reset();
+    /* Shadow map frustum and the corresponding camera frustum slice for
+       each layer, all submitted at once */
+    DebugLines::Frustum frusta[2*MaxShadowLayerCount];
     const Matrix4 imvp = (_mainCamera.projectionMatrix()*_mainCamera.cameraMatrix()).inverted();
     for(std::size_t layerIndex = 0; layerIndex != _shadowLight.layerCount(); ++layerIndex) {
         const Matrix4 layerMatrix = _shadowLight.layerMatrix(layerIndex);
         const Deg hue = layerIndex*360.0_degf/_shadowLight.layerCount();
-        _debugLines.addFrustum((unbiasMatrix*layerMatrix).inverted(),
-            Color3::fromHsv(hue, 1.0f, 0.5f));
-        _debugLines.addFrustum(imvp,
+        frusta[2*layerIndex] = {(unbiasMatrix*layerMatrix).inverted(),
+            Color3::fromHsv(hue, 1.0f, 0.5f), 1.0f, -1.0f};
+        frusta[2*layerIndex + 1] = {imvp,
             Color3::fromHsv(hue, 1.0f, 1.0f),
-            layerIndex == 0 ? 0 : _shadowLight.cutZ(layerIndex - 1), _shadowLight.cutZ(layerIndex));
+            layerIndex == 0 ? 0 : _shadowLight.cutZ(layerIndex - 1), _shadowLight.cutZ(layerIndex)};
     }
 
+    _debugLines.reset();
+    _debugLines.addFrusta(Containers::arrayView(frusta, 2*_shadowLight.layerCount()));
+
     _debugLines.draw(_activeCamera->projectionMatrix()*_activeCamera->cameraMatrix());
 }
 
@@ -370,12 +618,10 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
         setShadowSplitExponent(_layerSplitExponent /= 1.125f);
 
     } else if(event.key() == KeyEvent::Key::F7) {
-        _shadowReceiverShader.setShadowBias(_shadowBias /= 1.125f);
-        Debug() << "Shadow bias" << _shadowBias;
+        setShadowBias(_shadowBias/1.125f);
 
     } else if(event.key() == KeyEvent::Key::F8) {
-        _shadowReceiverShader.setShadowBias(_shadowBias *= 1.125f);
-        Debug() << "Shadow bias" << _shadowBias;
+        setShadowBias(_shadowBias*1.125f);
 
     } else if(event.key() == KeyEvent::Key::F9) {
         std::size_t numLayers = _shadowLight.layerCount() - 1;
@@ -388,13 +634,20 @@ void ShadowsExample::keyPressEvent(KeyEvent& event) {
 
     } else if(event.key() == KeyEvent::Key::F10) {
         std::size_t numLayers = _shadowLight.layerCount() + 1;
-        if(numLayers <= 32) {
+        if(numLayers <= MaxShadowLayerCount) {
             _shadowLight.setupShadowmaps(numLayers, _shadowMapSize);
             recompileReceiverShader(numLayers);
             _shadowLight.setupSplitDistances(MainCameraNear, MainCameraFar, _layerSplitExponent);
             Debug() << "Shadow map size" << _shadowMapSize << "x" << _shadowLight.layerCount() << "layers";
         } else return;
 
+    } else if(event.key() == KeyEvent::Key::C) {
+        if(!_gpuDrivenSupported) return;
+        _gpuDriven = !_gpuDriven;
+        /* The depth of the default framebuffer is not kept, start over */
+        _depthPyramidValid = false;
+        Debug() << "Rendering:" << (_gpuDriven ? "GPU-driven" : "per-object");
+
     } else if(event.key() == KeyEvent::Key::F11) {
         setShadowMapSize(_shadowMapSize/2);
 
@@ -418,6 +671,13 @@ void ShadowsExample::setShadowSplitExponent(const Float power) {
     Debug() << "Shadow splits power=" << power << "cut points:" << buf;
 }
 
+void ShadowsExample::setShadowBias(const Float bias) {
+    _shadowBias = bias;
+    _shadowReceiverShader.setShadowBias(bias);
+    if(_gpuDrivenSupported) _gpuShadowReceiverShader.setShadowBias(bias);
+    Debug() << "Shadow bias" << bias;
+}
+
 void ShadowsExample::setShadowMapSize(const Vector2i& shadowMapSize) {
     if((shadowMapSize >= Vector2i{1}).all() && (shadowMapSize <= GL::Texture2D::maxSize()).all()) {
         _shadowMapSize = shadowMapSize;
@@ -429,6 +689,11 @@ void ShadowsExample::setShadowMapSize(const Vector2i& shadowMapSize) {
 void ShadowsExample::recompileReceiverShader(const std::size_t numLayers) {
     _shadowReceiverShader = ShadowReceiverShader{numLayers};
     _shadowReceiverShader.setShadowBias(_shadowBias);
+    if(_gpuDrivenSupported) {
+        _gpuShadowReceiverShader = ShadowReceiverShader{numLayers,
+            ShadowReceiverShader::Flag::ObjectTransformations};
+        _gpuShadowReceiverShader.setShadowBias(_shadowBias);
+    }
     for(std::size_t i = 0; i != _shadowReceiverDrawables.size(); ++i) {
         auto& drawable = static_cast<ShadowReceiverDrawable&>(_shadowReceiverDrawables[i]);
         drawable.setShader(_shadowReceiverShader);
@@ -0,0 +1,132 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "StreamingBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <Magnum/GL/Context.h>
+#include <Magnum/GL/Extensions.h>
+
+namespace Magnum { namespace Examples {
+
+StreamingBuffer::StreamingBuffer(const std::size_t regionSize): _buffer{NoCreate}, _regionSize{} {
+    reserve(regionSize);
+}
+
+StreamingBuffer::~StreamingBuffer() {
+    for(GLsync fence: _fences) if(fence) glDeleteSync(fence);
+}
+
+void StreamingBuffer::reserve(const std::size_t regionSize) {
+    #ifndef MAGNUM_TARGET_GLES
+    if(GL::Context::current().isExtensionSupported<GL::Extensions::ARB::buffer_storage>()) {
+        const std::size_t totalSize = RegionCount*regionSize;
+        GL::Buffer buffer;
+        buffer.setStorage({nullptr, totalSize},
+            GL::Buffer::StorageFlag::MapWrite|
+            GL::Buffer::StorageFlag::MapPersistent|
+            GL::Buffer::StorageFlag::MapCoherent);
+        Containers::ArrayView<char> mapped = buffer.map(0, totalSize,
+            GL::Buffer::MapFlag::Write|
+            GL::Buffer::MapFlag::Persistent|
+            GL::Buffer::MapFlag::Coherent);
+        CORRADE_INTERNAL_ASSERT(mapped.data());
+
+        /* Carry over what was written in this frame already. Nothing reads
+           from the new storage yet, so start again from its first region and
+           drop the fences guarding the old one -- GL deletes the old buffer
+           only after all commands using it are finished. */
+        if(_size) std::memcpy(mapped.data(), _mapped.data() + regionOffset(), _size);
+        for(GLsync& fence: _fences) if(fence) {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        _buffer = std::move(buffer);
+        _mapped = mapped;
+        _regionSize = regionSize;
+        _region = 0;
+        return;
+    }
+    #endif
+
+    Containers::Array<char> data{Containers::NoInit, regionSize};
+    if(_size) std::memcpy(data.data(), _data.data(), _size);
+    _data = std::move(data);
+    _regionSize = regionSize;
+    if(!_buffer.id()) _buffer = GL::Buffer{};
+}
+
+void StreamingBuffer::begin() {
+    _size = 0;
+
+    /* The fallback path orphans the buffer in flush(), no need to wait */
+    if(!isPersistent()) return;
+
+    _region = (_region + 1) % RegionCount;
+    GLsync& fence = _fences[_region];
+    if(!fence) return;
+
+    /* Flush the command queue on the first try so we don't end up waiting
+       for a fence that was never submitted */
+    GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while(glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+        flags = 0;
+    glDeleteSync(fence);
+    fence = nullptr;
+}
+
+Containers::ArrayView<char> StreamingBuffer::allocate(const std::size_t size) {
+    if(_size + size > _regionSize)
+        reserve(std::max(2*_regionSize, _size + size));
+
+    const std::size_t offset = _size;
+    _size += size;
+    if(isPersistent())
+        return _mapped.slice(regionOffset() + offset, regionOffset() + _size);
+    return _data.slice(offset, _size);
+}
+
+void StreamingBuffer::flush() {
+    /* The mapping is coherent, nothing to do */
+    if(isPersistent()) return;
+
+    _buffer.setData(_data.prefix(_size), GL::BufferUsage::StreamDraw);
+}
+
+void StreamingBuffer::fence() {
+    if(!isPersistent()) return;
+
+    GLsync& fence = _fences[_region];
+    if(fence) glDeleteSync(fence);
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+}}
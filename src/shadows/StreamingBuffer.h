@@ -0,0 +1,134 @@
+#ifndef Magnum_Examples_StreamingBuffer_h
+#define Magnum_Examples_StreamingBuffer_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Corrade/Containers/Array.h>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/OpenGL.h>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Ring-buffered vertex stream
+
+Data written with @ref allocate() go directly to GPU-visible memory. The
+buffer is split into @ref RegionCount regions that are used in a round-robin
+fashion, each region is fenced after drawing from it and @ref begin() waits
+on the fence only when the region gets reused, so the CPU can fill a new
+frame while the GPU is still reading the previous ones. The storage is never
+reallocated unless a frame needs more than the current region size.
+
+If @gl_extension{ARB,buffer_storage} is not available, the data are
+collected in a CPU-side array and uploaded with @ref GL::Buffer::setData()
+in @ref flush() instead.
+*/
+class StreamingBuffer {
+    public:
+        enum: std::size_t { RegionCount = 3 };
+
+        /**
+         * @brief Constructor
+         * @param regionSize    Initial size of one region in bytes. Should be
+         *      a multiple of the vertex stride, see @ref regionOffset().
+         */
+        explicit StreamingBuffer(std::size_t regionSize);
+
+        /* Fences can't be copied */
+        StreamingBuffer(const StreamingBuffer&) = delete;
+        StreamingBuffer(StreamingBuffer&&) = delete;
+
+        ~StreamingBuffer();
+
+        StreamingBuffer& operator=(const StreamingBuffer&) = delete;
+        StreamingBuffer& operator=(StreamingBuffer&&) = delete;
+
+        /**
+         * @brief Underlying buffer
+         *
+         * The buffer object gets replaced when @ref allocate() needs to grow
+         * the storage, compare @ref GL::Buffer::id() to detect that and
+         * re-attach it to a mesh.
+         */
+        GL::Buffer& buffer() { return _buffer; }
+
+        /** @brief Whether the buffer is persistently mapped */
+        bool isPersistent() const { return !_mapped.empty(); }
+
+        /** @brief Size of one region in bytes */
+        std::size_t regionSize() const { return _regionSize; }
+
+        /**
+         * @brief Offset of the current region in bytes
+         *
+         * Divide by the vertex stride and use as a base vertex when drawing.
+         * Always @cpp 0 @ce if the buffer is not persistently mapped.
+         */
+        std::size_t regionOffset() const { return _region*_regionSize; }
+
+        /** @brief Count of bytes written to the current region */
+        std::size_t size() const { return _size; }
+
+        /**
+         * @brief Start a new frame
+         *
+         * Discards everything written so far, switches to the next region
+         * and waits until the GPU finished drawing from it.
+         */
+        void begin();
+
+        /**
+         * @brief Allocate space at the end of current region
+         *
+         * Returned view is valid until the next call to @ref allocate() or
+         * @ref begin().
+         */
+        Containers::ArrayView<char> allocate(std::size_t size);
+
+        /** @brief Make the data visible to the GPU. Call before drawing. */
+        void flush();
+
+        /** @brief Fence the current region. Call after drawing. */
+        void fence();
+
+    private:
+        void reserve(std::size_t size);
+
+        GL::Buffer _buffer;
+        /* Either the whole persistently mapped range of all regions or a
+           CPU-side copy of one region for the fallback path */
+        Containers::ArrayView<char> _mapped;
+        Containers::Array<char> _data;
+        std::size_t _regionSize, _region{}, _size{};
+        GLsync _fences[RegionCount]{};
+};
+
+}}
+
+#endif
@@ -0,0 +1,139 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "TaskPool.h"
+
+#include <algorithm>
+
+namespace Magnum { namespace Examples {
+
+TaskPool::TaskPool(std::size_t threadCount) {
+    if(!threadCount) threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    _queues.reset(new Queue[threadCount]);
+    _threads.reserve(threadCount - 1);
+    for(std::size_t i = 1; i != threadCount; ++i)
+        _threads.emplace_back(&TaskPool::work, this, i);
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _quit = true;
+    }
+    _wake.notify_all();
+    for(std::thread& thread: _threads) thread.join();
+}
+
+void TaskPool::run(const std::size_t count, const std::function<void(std::size_t)>& task) {
+    if(!count) return;
+
+    /* Single-threaded, no need to go through the queues */
+    if(_threads.empty()) {
+        for(std::size_t i = 0; i != count; ++i) task(i);
+        return;
+    }
+
+    /* The task pointer is read by the workers only after they pop an index
+       from a queue, the queue mutex orders that after this write */
+    _task = &task;
+    _remaining = count;
+    for(std::size_t i = 0; i != count; ++i) {
+        Queue& queue = _queues[i % threadCount()];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        queue.tasks.push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        ++_batch;
+    }
+    _wake.notify_all();
+
+    while(runOne(0)) {}
+
+    /* Wait for tasks that got stolen by the workers */
+    std::unique_lock<std::mutex> lock{_mutex};
+    _done.wait(lock, [this]{ return _remaining == 0; });
+}
+
+void TaskPool::work(const std::size_t thread) {
+    std::size_t batch = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{_mutex};
+            _wake.wait(lock, [&]{ return _quit || _batch != batch; });
+            if(_quit) return;
+            batch = _batch;
+        }
+
+        while(runOne(thread)) {}
+    }
+}
+
+bool TaskPool::runOne(const std::size_t thread) {
+    std::size_t index{};
+    bool found = false;
+
+    /* Own queue first, newest task */
+    {
+        Queue& queue = _queues[thread];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if(!queue.tasks.empty()) {
+            index = queue.tasks.back();
+            queue.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    /* Steal the oldest task from others */
+    for(std::size_t i = 1; !found && i != threadCount(); ++i) {
+        Queue& queue = _queues[(thread + i) % threadCount()];
+        std::lock_guard<std::mutex> lock{queue.mutex};
+        if(!queue.tasks.empty()) {
+            index = queue.tasks.front();
+            queue.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if(!found) return false;
+
+    (*_task)(index);
+
+    /* Last task of the batch, wake up run() */
+    if(--_remaining == 0) {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _done.notify_all();
+    }
+
+    return true;
+}
+
+}}
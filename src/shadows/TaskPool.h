@@ -0,0 +1,106 @@
+#ifndef Magnum_Examples_TaskPool_h
+#define Magnum_Examples_TaskPool_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Magnum { namespace Examples {
+
+/**
+@brief Work-stealing task pool
+
+Runs a batch of indexed tasks on a fixed set of threads. Tasks of a batch are
+distributed round-robin into per-thread queues, each thread takes tasks from
+the back of its own queue and when it runs out, it steals from the front of
+the other queues. That keeps all threads busy even if the tasks take very
+different amount of time, such as shadow cascades of different sizes.
+*/
+class TaskPool {
+    public:
+        /**
+         * @brief Constructor
+         * @param threadCount   Total count of threads including the calling
+         *      one. If @cpp 1 @ce, all tasks are executed directly in
+         *      @ref run(). If @cpp 0 @ce,
+         *      @ref std::thread::hardware_concurrency() is used.
+         */
+        explicit TaskPool(std::size_t threadCount = 0);
+
+        /* Threads can't be copied and the workers reference this instance */
+        TaskPool(const TaskPool&) = delete;
+        TaskPool(TaskPool&&) = delete;
+
+        ~TaskPool();
+
+        TaskPool& operator=(const TaskPool&) = delete;
+        TaskPool& operator=(TaskPool&&) = delete;
+
+        /** @brief Total count of threads including the calling one */
+        std::size_t threadCount() const { return _threads.size() + 1; }
+
+        /**
+         * @brief Run a batch of tasks
+         *
+         * Calls @p task with indices from @cpp 0 @ce to @cpp count - 1 @ce,
+         * the calling thread participates as well. Returns once all tasks
+         * are finished. Not reentrant.
+         */
+        void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::size_t> tasks;
+        };
+
+        void work(std::size_t thread);
+        bool runOne(std::size_t thread);
+
+        std::vector<std::thread> _threads;
+        std::unique_ptr<Queue[]> _queues;
+        const std::function<void(std::size_t)>* _task{};
+
+        std::mutex _mutex;
+        std::condition_variable _wake, _done;
+        std::size_t _batch{};
+        std::atomic<std::size_t> _remaining{};
+        bool _quit{};
+};
+
+}}
+
+#endif
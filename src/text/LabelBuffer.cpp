@@ -0,0 +1,178 @@
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "LabelBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <Corrade/Containers/ArrayView.h>
+#include <Corrade/Containers/Pointer.h>
+#include <Corrade/Utility/Assert.h>
+#include <Magnum/Math/Range.h>
+#include <Magnum/Shaders/AbstractVector.h>
+#include <Magnum/Text/AbstractFont.h>
+
+namespace Magnum { namespace Examples {
+
+namespace {
+    /* Changed ranges closer than this many vertices are uploaded together,
+       as a few bytes more are cheaper than another upload */
+    enum: std::size_t { MergeDistance = 64 };
+}
+
+LabelBuffer::LabelBuffer(Text::AbstractFont& font, const Text::GlyphCache& cache, const Float size, const UnsignedInt labelCount, const UnsignedInt glyphsPerLabel): _font(font), _cache(cache), _size{size}, _labelCapacity{labelCount}, _glyphsPerLabel{glyphsPerLabel}, _vertices(std::size_t(labelCount)*glyphsPerLabel*4), _layout(std::size_t(glyphsPerLabel)*4) {
+    _labels.reserve(labelCount);
+
+    /* All quads are zero-sized in the beginning */
+    _vertexBuffer.setData({_vertices.data(), _vertices.size()*sizeof(Vertex)}, GL::BufferUsage::DynamicDraw);
+
+    /* The indices never change. Two triangles for each glyph quad, with
+       vertices in order bottom left, bottom right, top left, top right. */
+    std::vector<UnsignedInt> indices(std::size_t(labelCount)*glyphsPerLabel*6);
+    for(UnsignedInt i = 0, glyphCount = labelCount*glyphsPerLabel; i != glyphCount; ++i) {
+        UnsignedInt* const quad = indices.data() + i*6;
+        quad[0] = i*4 + 0;
+        quad[1] = i*4 + 1;
+        quad[2] = i*4 + 2;
+        quad[3] = i*4 + 2;
+        quad[4] = i*4 + 1;
+        quad[5] = i*4 + 3;
+    }
+    _indexBuffer.setData(Containers::arrayView(indices.data(), indices.size()), GL::BufferUsage::StaticDraw);
+
+    _mesh.setPrimitive(GL::MeshPrimitive::Triangles)
+        .setCount(0)
+        .addVertexBuffer(_vertexBuffer, 0,
+            Shaders::AbstractVector2D::Position{},
+            Shaders::AbstractVector2D::TextureCoordinates{})
+        .setIndexBuffer(_indexBuffer, 0, GL::MeshIndexType::UnsignedInt);
+}
+
+UnsignedInt LabelBuffer::addLabel(const Vector2& position, const LabelAlignment alignment) {
+    CORRADE_ASSERT(_labels.size() < _labelCapacity,
+        "LabelBuffer::addLabel(): only" << _labelCapacity << "labels can be added", {});
+
+    _labels.push_back({position, alignment, {}});
+
+    /* Draw only the labels that were added */
+    _mesh.setCount(Int(_labels.size()*_glyphsPerLabel*6));
+    return UnsignedInt(_labels.size() - 1);
+}
+
+void LabelBuffer::setText(const UnsignedInt id, const std::string& text) {
+    Label& label = _labels[id];
+    if(label.text == text) return;
+    label.text = text;
+
+    /* Lay out all glyphs line by line, unused quads stay zero-sized */
+    std::fill(_layout.begin(), _layout.end(), Vertex{});
+    const Float lineAdvance = _font.lineHeight()*_size/_font.size();
+    UnsignedInt glyph = 0;
+    Float top{};
+    std::size_t lineBegin = 0;
+    for(Int line = 0; lineBegin <= text.size() && glyph != _glyphsPerLabel; ++line) {
+        std::size_t lineEnd = text.find('\n', lineBegin);
+        if(lineEnd == std::string::npos) lineEnd = text.size();
+
+        const Containers::Pointer<Text::AbstractLayouter> layouter = _font.layout(_cache, _size, text.substr(lineBegin, lineEnd - lineBegin));
+        const UnsignedInt lineGlyphBegin = glyph;
+        Vector2 cursorPosition{0.0f, -Float(line)*lineAdvance};
+        Range2D rectangle;
+        for(UnsignedInt i = 0; i != layouter->glyphCount() && glyph != _glyphsPerLabel; ++i, ++glyph) {
+            Range2D quadPosition, textureCoordinates;
+            std::tie(quadPosition, textureCoordinates) = layouter->renderGlyph(i, cursorPosition, rectangle);
+
+            Vertex* const quad = _layout.data() + glyph*4;
+            quad[0] = {quadPosition.bottomLeft(), textureCoordinates.bottomLeft()};
+            quad[1] = {quadPosition.bottomRight(), textureCoordinates.bottomRight()};
+            quad[2] = {quadPosition.topLeft(), textureCoordinates.topLeft()};
+            quad[3] = {quadPosition.topRight(), textureCoordinates.topRight()};
+        }
+
+        /* Right-aligned lines end at the label position */
+        if(label.alignment == LabelAlignment::TopRight)
+            for(UnsignedInt i = lineGlyphBegin*4; i != glyph*4; ++i)
+                _layout[i].position.x() -= rectangle.right();
+        if(line == 0) top = rectangle.top();
+
+        lineBegin = lineEnd + 1;
+    }
+
+    /* Move the whole text to the label position */
+    const Vector2 offset = label.position - Vector2::yAxis(label.alignment == LabelAlignment::TopRight ? top : 0.0f);
+    for(UnsignedInt i = 0; i != glyph*4; ++i)
+        _layout[i].position += offset;
+
+    /* Find the first and last glyph that differs from what's in the buffer.
+       If the text changed only in a few characters, the rest is laid out the
+       same as before. */
+    Vertex* const vertices = _vertices.data() + std::size_t(id)*_glyphsPerLabel*4;
+    const std::size_t quadSize = 4*sizeof(Vertex);
+    UnsignedInt begin = 0, end = _glyphsPerLabel;
+    while(begin != end && std::memcmp(vertices + begin*4, _layout.data() + begin*4, quadSize) == 0)
+        ++begin;
+    while(end != begin && std::memcmp(vertices + (end - 1)*4, _layout.data() + (end - 1)*4, quadSize) == 0)
+        --end;
+    if(begin == end) return;
+
+    std::copy(_layout.begin() + begin*4, _layout.begin() + end*4, vertices + begin*4);
+    const std::size_t labelOffset = std::size_t(id)*_glyphsPerLabel*4;
+    _changed.emplace_back(labelOffset + begin*4, labelOffset + end*4);
+}
+
+std::size_t LabelBuffer::update() {
+    if(_changed.empty()) return 0;
+
+    /* Upload everything if not diffing */
+    if(!_diffing) {
+        _changed.clear();
+        _vertexBuffer.setSubData(0, Containers::arrayView(_vertices.data(), _vertices.size()));
+        return _vertices.size()*sizeof(Vertex);
+    }
+
+    /* Upload the changed ranges in order, merging the ones that are close
+       to each other */
+    std::sort(_changed.begin(), _changed.end());
+    std::size_t uploaded = 0;
+    for(std::size_t i = 0; i != _changed.size(); ) {
+        const std::size_t begin = _changed[i].first;
+        std::size_t end = _changed[i].second;
+        for(++i; i != _changed.size() && _changed[i].first <= end + MergeDistance; ++i)
+            end = std::max(end, _changed[i].second);
+
+        _vertexBuffer.setSubData(begin*sizeof(Vertex), Containers::arrayView(_vertices.data() + begin, end - begin));
+        uploaded += (end - begin)*sizeof(Vertex);
+    }
+
+    _changed.clear();
+    return uploaded;
+}
+
+}}
@@ -0,0 +1,152 @@
+#ifndef Magnum_Examples_LabelBuffer_h
+#define Magnum_Examples_LabelBuffer_h
+/*
+    This file is part of Magnum.
+
+    Original authors — credit is appreciated but not required:
+
+        2010, 2011, 2012, 2013, 2014, 2015, 2016, 2017, 2018, 2019 —
+            Vladimír Vondruš <mosra@centrum.cz>
+
+    This is free and unencumbered software released into the public domain.
+
+    Anyone is free to copy, modify, publish, use, compile, sell, or distribute
+    this software, either in source code form or as a compiled binary, for any
+    purpose, commercial or non-commercial, and by any means.
+
+    In jurisdictions that recognize copyright laws, the author or authors of
+    this software dedicate any and all copyright interest in the software to
+    the public domain. We make this dedication for the benefit of the public
+    at large and to the detriment of our heirs and successors. We intend this
+    dedication to be an overt act of relinquishment in perpetuity of all
+    present and future rights to this software under copyright law.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+    THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+    IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+    CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <Magnum/GL/Buffer.h>
+#include <Magnum/GL/Mesh.h>
+#include <Magnum/Math/Vector2.h>
+#include <Magnum/Text/Text.h>
+
+namespace Magnum { namespace Examples {
+
+/** @brief Label alignment */
+enum class LabelAlignment {
+    /** Left side of the first line at the label position */
+    LineLeft,
+
+    /** Top right corner of the text at the label position */
+    TopRight
+};
+
+/**
+@brief Text labels sharing a persistent buffer
+
+All labels are in a single vertex buffer with a fixed amount of glyph quads
+reserved for each, so they're drawn with a single draw call and the index
+buffer is generated just once. Changing a label text lays out the glyphs on
+the CPU, compares the resulting quads with the ones already in the buffer
+and remembers just the range that differs. Changed ranges of all labels are
+uploaded at once in @ref update(), merging ranges that are close to each
+other. For a counter or a value that changes in the last few digits this is
+just a small part of the label.
+
+Unlike @ref Text::Renderer, the glyph quads aren't mapped, the buffer is
+never reallocated and a text that's the same as before costs only a string
+comparison.
+*/
+class LabelBuffer {
+    public:
+        /**
+         * @brief Constructor
+         * @param font              Font to lay out the text with
+         * @param cache             Glyph cache
+         * @param size              Font size
+         * @param labelCount        Max count of labels
+         * @param glyphsPerLabel    Max count of glyphs in a label, including
+         *      glyphs for whitespace. Glyphs past this count are cut away.
+         *
+         * The font and glyph cache are expected to stay in scope for the
+         * whole lifetime of the instance.
+         */
+        explicit LabelBuffer(Text::AbstractFont& font, const Text::GlyphCache& cache, Float size, UnsignedInt labelCount, UnsignedInt glyphsPerLabel);
+
+        /**
+         * @brief Add a label
+         * @return Label ID to be passed to @ref setText()
+         *
+         * The label is empty until its text is set. Expects that the
+         * label count passed in the constructor isn't exceeded.
+         */
+        UnsignedInt addLabel(const Vector2& position, LabelAlignment alignment = LabelAlignment::LineLeft);
+
+        /**
+         * @brief Set label text
+         *
+         * The text can contain newlines. The changed glyphs are uploaded
+         * during the next @ref update().
+         */
+        void setText(UnsignedInt id, const std::string& text);
+
+        /**
+         * @brief Whether to upload only changed ranges
+         *
+         * Enabled by default. If disabled, @ref update() uploads the whole
+         * buffer whenever any label changed, which is useful for comparison.
+         */
+        LabelBuffer& setDiffing(bool enabled) {
+            _diffing = enabled;
+            return *this;
+        }
+
+        /**
+         * @brief Upload changed glyphs
+         * @return Count of uploaded bytes
+         */
+        std::size_t update();
+
+        /** @brief Mesh with all labels */
+        GL::Mesh& mesh() { return _mesh; }
+
+    private:
+        struct Vertex {
+            Vector2 position;
+            Vector2 textureCoordinates;
+        };
+
+        struct Label {
+            Vector2 position;
+            LabelAlignment alignment;
+            std::string text;
+        };
+
+        Text::AbstractFont& _font;
+        const Text::GlyphCache& _cache;
+        Float _size;
+        UnsignedInt _labelCapacity, _glyphsPerLabel;
+        bool _diffing{true};
+
+        std::vector<Label> _labels;
+        /* Same contents as the vertex buffer */
+        std::vector<Vertex> _vertices;
+        /* Newly laid out quads of one label */
+        std::vector<Vertex> _layout;
+        /* Vertex ranges that differ from the buffer, begin and end */
+        std::vector<std::pair<std::size_t, std::size_t>> _changed;
+
+        GL::Buffer _vertexBuffer, _indexBuffer;
+        GL::Mesh _mesh;
+};
+
+}}
+
+#endif
@@ -27,6 +27,11 @@
     CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <Corrade/Utility/Arguments.h>
 #include <Corrade/Utility/Format.h>
 #include <Corrade/PluginManager/Manager.h>
 #include <Magnum/GL/DefaultFramebuffer.h>
@@ -38,6 +43,9 @@
 #include <Magnum/Text/AbstractFont.h>
 #include <Magnum/Text/DistanceFieldGlyphCache.h>
 #include <Magnum/Text/Renderer.h>
+#include <Magnum/Timeline.h>
+
+#include "LabelBuffer.h"
 
 namespace Magnum { namespace Examples {
 
@@ -61,13 +69,33 @@ class TextExample: public Platform::Application {
         GL::Mesh _text;
         GL::Buffer _vertices, _indices;
         Containers::Pointer<Text::Renderer2D> _text2;
+        /* Used instead of _text2 with --label-buffer */
+        Containers::Pointer<LabelBuffer> _status;
         Shaders::DistanceFieldVector2D _shader;
 
         Matrix3 _transformation;
         Matrix3 _projection;
+
+        /* Benchmark with many labels changing every frame. The update and
+           upload time and uploaded size is averaged over a second and shown
+           in the window title. */
+        Containers::Pointer<LabelBuffer> _labels;
+        std::vector<std::string> _labelTexts;
+        Matrix3 _labelTransformation;
+        Timeline _timeline;
+        Double _labelUpdateTime{};
+        std::size_t _labelUploadSize{}, _labelFrameCount{};
+        Float _labelTime{}, _labelStatsDuration{};
 };
 
 TextExample::TextExample(const Arguments& arguments): Platform::Application{arguments, Configuration{}.setTitle("Magnum Text Example")}, _cache(Vector2i(2048), Vector2i(512), 22), _text{NoCreate} {
+    Utility::Arguments args;
+    args.addBooleanOption("label-buffer").setHelp("label-buffer", "render the rotation and scale text with a persistent label buffer")
+        .addOption("benchmark-labels", "0").setHelp("benchmark-labels", "draw this many labels changing every frame and show the update time", "N")
+        .addBooleanOption("no-diff").setHelp("no-diff", "upload the whole label buffer instead of just the changed parts")
+        .addSkippedPrefix("magnum").setHelp("engine-specific options")
+        .parse(arguments.argc, arguments.argv);
+
     /* Load FreeTypeFont plugin */
     _font = _manager.loadAndInstantiate("FreeTypeFont");
     if(!_font) std::exit(1);
@@ -88,8 +116,31 @@ TextExample::TextExample(const Arguments& arguments): Platform::Application{argu
         "Hej Världen!",
         _vertices, _indices, GL::BufferUsage::StaticDraw, Text::Alignment::MiddleCenter);
 
-    _text2.reset(new Text::Renderer2D(*_font, _cache, 0.035f, Text::Alignment::TopRight));
-    _text2->reserve(40, GL::BufferUsage::DynamicDraw, GL::BufferUsage::StaticDraw);
+    /* The label buffer keeps all glyph quads in place and uploads only the
+       ones that changed */
+    if(args.isSet("label-buffer")) {
+        _status.reset(new LabelBuffer{*_font, _cache, 0.035f, 1, 40});
+        _status->addLabel({}, LabelAlignment::TopRight);
+    } else {
+        _text2.reset(new Text::Renderer2D(*_font, _cache, 0.035f, Text::Alignment::TopRight));
+        _text2->reserve(40, GL::BufferUsage::DynamicDraw, GL::BufferUsage::StaticDraw);
+    }
+
+    /* Labels for the benchmark in a grid, roughly in the window aspect
+       ratio. A label is eight units wide and one and a half high. */
+    if(const UnsignedInt labelCount = args.value<UnsignedInt>("benchmark-labels")) {
+        const UnsignedInt columns = UnsignedInt(std::ceil(std::sqrt(labelCount/4.0f)));
+        const UnsignedInt rows = (labelCount + columns - 1)/columns;
+        const Vector2 gridSize{columns*8.0f, rows*1.5f};
+        _labels.reset(new LabelBuffer{*_font, _cache, 1.0f, labelCount, 16});
+        _labels->setDiffing(!args.isSet("no-diff"));
+        for(UnsignedInt i = 0; i != labelCount; ++i)
+            _labels->addLabel({(i % columns)*8.0f, (rows - i/columns - 1)*1.5f + 0.4f});
+        _labelTexts.resize(labelCount);
+        _labelTransformation = Matrix3::scaling(Vector2{2.0f/gridSize.x()})*
+            Matrix3::translation(-gridSize*0.5f);
+        _timeline.start();
+    }
 
     GL::Renderer::enable(GL::Renderer::Feature::Blending);
     GL::Renderer::setBlendFunction(GL::Renderer::BlendFunction::SourceAlpha, GL::Renderer::BlendFunction::OneMinusSourceAlpha);
@@ -123,9 +174,43 @@ void TextExample::drawEvent() {
         .setColor(Color3{1.0f})
         .setOutlineRange(0.5f, 1.0f)
         .setSmoothness(0.075f);
-    _text2->mesh().draw(_shader);
+    (_status ? _status->mesh() : _text2->mesh()).draw(_shader);
+
+    /* Change all benchmark labels, only the update and upload is measured */
+    if(_labels) {
+        _labelTime += _timeline.previousFrameDuration();
+        for(std::size_t i = 0; i != _labelTexts.size(); ++i)
+            _labelTexts[i] = Utility::formatString("{}: {:.3f}", i, _labelTime*Float(i % 10 + 1));
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for(std::size_t i = 0; i != _labelTexts.size(); ++i)
+            _labels->setText(UnsignedInt(i), _labelTexts[i]);
+        _labelUploadSize += _labels->update();
+        _labelUpdateTime += std::chrono::duration<Double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        _shader.setTransformationProjectionMatrix(_projection*_labelTransformation)
+            .setColor(Color3{1.0f})
+            .setOutlineRange(0.5f, 1.0f)
+            .setSmoothness(0.075f);
+        _labels->mesh().draw(_shader);
+
+        ++_labelFrameCount;
+        if((_labelStatsDuration += _timeline.previousFrameDuration()) >= 1.0f) {
+            setWindowTitle(Utility::formatString("Magnum Text Example | {} labels, update {:.2f} ms, {:.1f} kB uploaded per frame",
+                _labelTexts.size(), _labelUpdateTime/_labelFrameCount,
+                _labelUploadSize/1024.0/_labelFrameCount));
+            _labelUpdateTime = 0.0;
+            _labelUploadSize = _labelFrameCount = 0;
+            _labelStatsDuration = 0.0f;
+        }
+    }
 
     swapBuffers();
+
+    if(_labels) {
+        _timeline.nextFrame();
+        redraw();
+    }
 }
 
 void TextExample::mouseScrollEvent(MouseScrollEvent& event) {
@@ -143,9 +228,13 @@ void TextExample::mouseScrollEvent(MouseScrollEvent& event) {
 }
 
 void TextExample::updateText() {
-    _text2->render(Utility::formatString("Rotation: {:.2}°\nScale: {:.2}",
+    const std::string text = Utility::formatString("Rotation: {:.2}°\nScale: {:.2}",
         Float(Deg(Complex::fromMatrix(_transformation.rotation()).angle())),
-        _transformation.uniformScaling()));
+        _transformation.uniformScaling());
+    if(_status) {
+        _status->setText(0, text);
+        _status->update();
+    } else _text2->render(text);
 }
 
 }}